@@ -138,13 +138,13 @@ dir_lookup (const struct dir *dir, const char *name,
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  inode_lock (dir -> inode);
+  inode_lock_shared (dir -> inode);
   if (lookup (dir, name, &e, NULL)){
     
     /* Inode open cannot be called if trying to open cwd as reopen 
        tries to reaquire lock on directory inode */
     if(inode_get_inumber(dir->inode) == e.inode_sector){
-      inode_unlock (dir -> inode);
+      inode_unlock_shared (dir -> inode);
       *inode = inode_reopen (dir->inode);
       return *inode != NULL;
     }
@@ -153,7 +153,7 @@ dir_lookup (const struct dir *dir, const char *name,
   else
     *inode = NULL;
 
-  inode_unlock (dir -> inode);
+  inode_unlock_shared (dir -> inode);
 
   return *inode != NULL;
 }
@@ -264,18 +264,18 @@ bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
-  inode_lock (dir -> inode);
+  inode_lock_shared (dir -> inode);
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
   {
     dir->pos += sizeof e;
     if (e.in_use)
     {
       strlcpy (name, e.name, NAME_MAX + 1);
-      inode_unlock (dir -> inode);
+      inode_unlock_shared (dir -> inode);
       return true;
     } 
   }
-  inode_unlock (dir -> inode);
+  inode_unlock_shared (dir -> inode);
   return false;
 }
 
@@ -371,10 +371,10 @@ void
 dir_seek (struct dir *dir,off_t pos)
 {
   ASSERT(dir != NULL);
-  lock_acquire(&dir_get_inode(dir)->lk);
+  inode_lock(dir_get_inode(dir));
   if(pos > 0)
     dir->pos = pos;
-  lock_release(&dir_get_inode(dir)->lk);
+  inode_unlock(dir_get_inode(dir));
 }
 
 size_t 
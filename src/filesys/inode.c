@@ -8,9 +8,12 @@
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
 #include "filesys/bcache.h"
+#ifdef USERPROG
+#include "userprog/process.h"
+#endif
 
 
-static uint32_t find_block(struct inode_disk *inode, block_sector_t sector, uint32_t file_sector);
+static uint32_t find_block(struct inode_disk *inode, block_sector_t sector, uint32_t file_sector, bool create);
 static void inode_change_length(struct inode *inode,off_t length);
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -22,30 +25,65 @@ bytes_to_sectors (off_t size)
 }
 
 
+/* Returns the block device sector that contains byte offset POS
+   within INODE, allocating it if CREATE is true, or 0 if there is
+   none. */
+static block_sector_t
+lookup_sector (struct inode *inode, off_t pos, bool create)
+{
+  struct inode_disk *disk_inode = malloc(sizeof(struct inode_disk));
+  read_bcache(inode->sector,disk_inode,0,sizeof (struct inode_disk));
+  block_sector_t sector_id = find_block(disk_inode, inode->sector, pos/BLOCK_SECTOR_SIZE, create);
+  free(disk_inode);
+  return sector_id;
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
+   Returns 0 if INODE does not contain data for a byte at offset
    POS. If inode is a directory then must be called with inode->lk
-   acquired. */
+   acquired, and sectors are allocated only if it is held
+   exclusively. A file's sectors are looked up with inode->lk
+   shared and a missing one is allocated with it exclusive. */
 static block_sector_t
 byte_to_sector (struct inode *inode, off_t pos) 
 {
-  bool eof_flag = false;
-  if(!inode_isDir(inode))
+  block_sector_t sector_id;
+
+  if(inode_isDir(inode))
+    return lookup_sector (inode, pos,
+                          rwlock_held_by_current_thread (&inode -> lk));
+
+  rwlock_acquire_read (&inode -> lk);
+  sector_id = lookup_sector (inode, pos, false);
+  rwlock_release_read (&inode -> lk);
+  if (sector_id == 0)
   {
-    lock_acquire (&inode -> lk);
-    eof_flag = true;
+    rwlock_acquire_write (&inode -> lk);
+    sector_id = lookup_sector (inode, pos, true);
+    rwlock_release_write (&inode -> lk);
   }
-  struct inode_disk *disk_inode = malloc(sizeof(struct inode_disk));
-  read_bcache(inode->sector,disk_inode,0,sizeof (struct inode_disk));
-  block_sector_t sector_id = find_block(disk_inode, inode->sector, pos/BLOCK_SECTOR_SIZE);
-  free(disk_inode);
-  
-  if (eof_flag)
-    lock_release (&inode -> lk);
   return sector_id;
 }
 
+/* Asks the readahead thread for the sector holding byte POS of
+   INODE. Nothing is allocated, and holes are skipped. If inode is
+   a directory then must be called with inode->lk acquired. */
+static void
+readahead_sector (struct inode *inode, off_t pos)
+{
+  block_sector_t sector_id;
+  bool is_dir = inode_isDir (inode);
+
+  if (!is_dir)
+    rwlock_acquire_read (&inode -> lk);
+  sector_id = lookup_sector (inode, pos, false);
+  if (!is_dir)
+    rwlock_release_read (&inode -> lk);
+  if (sector_id != 0)
+    request_readahead (sector_id);
+}
+
 /* List of open inodes, so that opening a single inode twice
    returns the same `struct inode'. */
 static struct list open_inodes;
@@ -92,7 +130,7 @@ inode_create (block_sector_t sector, off_t length, int type)
   sectors_allocated = malloc((size_t)sectors*sizeof(uint32_t));
   
   for(i=0; i<sectors; i++){
-    sectors_allocated[i] = find_block(disk_inode, sector, i);
+    sectors_allocated[i] = find_block(disk_inode, sector, i, true);
     if(sectors_allocated[i] == 0){
       free (disk_inode);
       goto invalid;
@@ -152,8 +190,9 @@ inode_open (block_sector_t sector)
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
+  inode->write_cnt = 0;
   inode->removed = false;
-  lock_init (&inode -> lk);
+  rwlock_init (&inode -> lk);
   
   list_push_front (&open_inodes, &inode->elem);
   lock_release(&open_inode_lock);
@@ -181,6 +220,14 @@ inode_get_inumber (const struct inode *inode)
   return inode->sector;
 }
 
+/* Returns the number of writes made to INODE since it was opened.
+   Anything cached about its contents is stale once this changes. */
+unsigned
+inode_write_cnt (const struct inode *inode)
+{
+  return inode->write_cnt;
+}
+
 /* Closes INODE and writes it to disk.
    If this was the last reference to INODE, frees its memory.
    If INODE was also a removed inode, frees its blocks. */
@@ -200,6 +247,10 @@ inode_close (struct inode *inode)
     
     /* Remove from inode list and release lock. */
     list_remove (&inode->elem);
+#ifdef USERPROG
+    if (inode->removed || inode->write_cnt > 0)
+      process_exec_cache_forget (inode->sector);
+#endif
     /* Deallocate blocks if removed. */
     if (inode->removed) 
     {
@@ -278,7 +329,7 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   free (bounce);
 
   if(inode_length(inode) > offset + BLOCK_SECTOR_SIZE){
-    request_readahead(byte_to_sector(inode, offset + BLOCK_SECTOR_SIZE));
+    readahead_sector(inode, offset + BLOCK_SECTOR_SIZE);
   }
   return bytes_read;
 }
@@ -331,7 +382,7 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 
   if(!inode_isDir(inode))
   {
-    lock_acquire (&inode -> lk);
+    rwlock_acquire_write (&inode -> lk);
     eof_flag = true;
   }
   
@@ -341,14 +392,16 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   if(inode_length(inode) < initial_offset + bytes_written){
     inode_change_length(inode, initial_offset + bytes_written);
   }
+  if (bytes_written > 0)
+    inode->write_cnt++;
     
   if (eof_flag)
-    lock_release (&inode -> lk);
+    rwlock_release_write (&inode -> lk);
 
   free (bounce);
   
   if(inode_length(inode) > offset + BLOCK_SECTOR_SIZE){
-    request_readahead(byte_to_sector(inode, offset + BLOCK_SECTOR_SIZE));
+    readahead_sector(inode, offset + BLOCK_SECTOR_SIZE);
   }
   
   return bytes_written;
@@ -359,10 +412,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
-  lock_acquire(&inode->lk);
+  rwlock_acquire_write(&inode->lk);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
-  lock_release(&inode->lk);
+  rwlock_release_write(&inode->lk);
 }
 
 /* Re-enables writes to INODE.
@@ -371,11 +424,23 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
-  lock_acquire(&inode->lk);
+  rwlock_acquire_write(&inode->lk);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
-  lock_release(&inode->lk);
+  rwlock_release_write(&inode->lk);
+}
+
+/* Asks the readahead thread to bring the sectors holding SIZE
+   bytes of INODE starting at OFFSET into the buffer cache. */
+void
+inode_readahead (struct inode *inode, off_t offset, off_t size)
+{
+  off_t length = inode_length (inode);
+  off_t end = size < length - offset ? offset + size : length;
+  for (offset = ROUND_DOWN (offset, BLOCK_SECTOR_SIZE); offset < end;
+       offset += BLOCK_SECTOR_SIZE)
+    readahead_sector (inode, offset);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -420,16 +485,17 @@ inode_change_length(struct inode *inode, off_t length)
   indirect blocks are listed in ip->addrs[NDIRECT+1]
 
   Return the disk block address of the nth block in inode ip.
-  If there is no such block, new block is allocated . This assumes 
+  If there is no such block, new block is allocated if CREATE is
+  true and 0 is returned otherwise. This assumes 
   that size of file is not less than the file_sector*sector_size */
 static uint32_t
-find_block(struct inode_disk *inode, block_sector_t sector, uint32_t file_sector)
+find_block(struct inode_disk *inode, block_sector_t sector, uint32_t file_sector, bool create)
 {
   
   uint32_t addr, *buffer = malloc(BLOCK_SECTOR_SIZE);
   if(file_sector < NDIRECT){
     if((int)inode->addrs[file_sector] == 0){
-      if(!free_map_allocate(1,&inode->addrs[file_sector])){
+      if(!create || !free_map_allocate(1,&inode->addrs[file_sector])){
         free(buffer);
         return 0;
       }
@@ -451,7 +517,7 @@ find_block(struct inode_disk *inode, block_sector_t sector, uint32_t file_sector
   if(file_sector < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if(inode->addrs[NDIRECT] == 0){
-      if(!free_map_allocate(1,&inode->addrs[NDIRECT])){
+      if(!create || !free_map_allocate(1,&inode->addrs[NDIRECT])){
         free(buffer);
         return 0;
       }
@@ -464,7 +530,7 @@ find_block(struct inode_disk *inode, block_sector_t sector, uint32_t file_sector
 
       
     if(buffer[file_sector] == 0){
-      if(!free_map_allocate(1,&buffer[file_sector])){
+      if(!create || !free_map_allocate(1,&buffer[file_sector])){
         free(buffer);
         return 0;
       }
@@ -488,7 +554,7 @@ find_block(struct inode_disk *inode, block_sector_t sector, uint32_t file_sector
   
   if(file_sector < NDINDIRECT){
     if(inode->addrs[NDIRECT+1] == 0){
-      if(!free_map_allocate(1,&inode->addrs[NDIRECT+1])){
+      if(!create || !free_map_allocate(1,&inode->addrs[NDIRECT+1])){
         free(buffer);
         return 0;
       }
@@ -502,7 +568,7 @@ find_block(struct inode_disk *inode, block_sector_t sector, uint32_t file_sector
     uint32_t second_level = file_sector%NINDIRECT;
     addr = buffer[first_level];
     if(addr == 0){
-      if(!free_map_allocate(1,&buffer[first_level])){
+      if(!create || !free_map_allocate(1,&buffer[first_level])){
         free(buffer);
         return 0;
       }
@@ -515,7 +581,7 @@ find_block(struct inode_disk *inode, block_sector_t sector, uint32_t file_sector
       
     
     if(buffer[second_level] == 0){
-      if(!free_map_allocate(1,&buffer[second_level])){
+      if(!create || !free_map_allocate(1,&buffer[second_level])){
         free(buffer);
         return 0;
       }
@@ -582,14 +648,28 @@ free_inode_data(struct inode_disk *inode)
   free(buffer);
 }
 
+/* Acquires INODE's lock exclusively, for changing its contents. */
 void
 inode_lock (struct inode * inode)
 {
-  lock_acquire (&inode -> lk);
+  rwlock_acquire_write (&inode -> lk);
 }
 
 void
 inode_unlock (struct inode * inode)
 {
-  lock_release (&inode -> lk);
+  rwlock_release_write (&inode -> lk);
+}
+
+/* Acquires INODE's lock shared, for reading its contents. */
+void
+inode_lock_shared (struct inode * inode)
+{
+  rwlock_acquire_read (&inode -> lk);
+}
+
+void
+inode_unlock_shared (struct inode * inode)
+{
+  rwlock_release_read (&inode -> lk);
 }
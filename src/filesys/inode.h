@@ -42,8 +42,9 @@ struct inode
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    unsigned write_cnt;                 /* Number of writes to the inode. */
     //struct inode_disk data;             /* Inode content. */
-    struct lock lk;                     /* per-inode lock */
+    struct rwlock lk;                   /* per-inode lock */
   };
                                                 
 void inode_init (void);
@@ -51,6 +52,7 @@ bool inode_create (block_sector_t, off_t,int type);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
+unsigned inode_write_cnt (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
@@ -58,9 +60,12 @@ off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+void inode_readahead (struct inode *, off_t offset, off_t size);
 bool inode_isremoved(struct inode *inode);
 bool inode_isDir(struct inode *inode);
 void inode_unlock (struct inode * inode);
 void inode_lock (struct inode * inode);
+void inode_unlock_shared (struct inode * inode);
+void inode_lock_shared (struct inode * inode);
 void free_inode_data(struct inode_disk *inode);
 #endif /* filesys/inode.h */
@@ -23,6 +23,15 @@ enum
     /* Project 3 and optionally project 4. */
     SYS_MMAP,                   /* Map a file into memory. */
     SYS_MUNMAP,                 /* Remove a memory mapping. */
+    SYS_MSYNC,                  /* Write back a memory mapping. */
+    SYS_MADVISE,                /* Give access hints for a memory range. */
+    SYS_MEMSTAT,                /* Report memory usage. */
+    SYS_SET_RSS_LIMIT,          /* Limit resident memory. */
+    SYS_FORK,                   /* Clone this process. */
+    SYS_VMTRACE,                /* Report recent page faults. */
+    SYS_NICE,                   /* Change scheduling niceness. */
+    SYS_GET_LOAD_AVG,           /* Report the system load average. */
+    SYS_GET_RECENT_CPU,         /* Report recent CPU use. */
 
     /* Project 4 only. */
     SYS_CHDIR,                  /* Change the current directory. */
@@ -153,6 +153,60 @@ munmap (mapid_t mapid)
   syscall1 (SYS_MUNMAP, mapid);
 }
 
+void
+msync (mapid_t mapid)
+{
+  syscall1 (SYS_MSYNC, mapid);
+}
+
+bool
+madvise (void *addr, unsigned length, int advice)
+{
+  return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+bool
+memstat (struct memstat *stat)
+{
+  return syscall1 (SYS_MEMSTAT, stat);
+}
+
+bool
+set_rss_limit (int pages)
+{
+  return syscall1 (SYS_SET_RSS_LIMIT, pages);
+}
+
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
+int
+vmtrace (struct vmtrace_event *events, int cnt)
+{
+  return syscall2 (SYS_VMTRACE, events, cnt);
+}
+
+int
+nice (int increment)
+{
+  return syscall1 (SYS_NICE, increment);
+}
+
+int
+get_load_avg (void)
+{
+  return syscall0 (SYS_GET_LOAD_AVG);
+}
+
+int
+get_recent_cpu (void)
+{
+  return syscall0 (SYS_GET_RECENT_CPU);
+}
+
 bool
 chdir (const char *dir)
 {
@@ -0,0 +1,115 @@
+/* Measures what sleeping threads cost the rest of the system.
+   Sleepers should stay off the run queue until they are due, so
+   they cause no context switches while they sleep, and the CPU
+   goes idle when every thread is asleep. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SLEEPER_CNT 10
+#define SLEEP_TICKS 100
+
+/* Context switches allowed per sleeper.  One to go to sleep, one
+   to wake up and exit, plus slack for the idle thread. */
+#define SWITCHES_PER_SLEEPER 4
+
+static void sleeper (void *);
+static void start_sleepers (struct semaphore *done);
+static void wait_sleepers (struct semaphore *done);
+
+/* Puts every thread to sleep at once and checks that the idle
+   thread got the CPU for most of the interval. */
+void
+test_alarm_idle (void) 
+{
+  struct semaphore done;
+  long long idle, switches;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  msg ("Putting %d threads and the main thread to sleep for %d ticks.",
+       SLEEPER_CNT, SLEEP_TICKS);
+  idle = thread_idle_ticks ();
+  switches = thread_switch_cnt ();
+  start_sleepers (&done);
+  timer_sleep (SLEEP_TICKS);
+  wait_sleepers (&done);
+  idle = thread_idle_ticks () - idle;
+  switches = thread_switch_cnt () - switches;
+
+  if (idle < SLEEP_TICKS / 2)
+    fail ("only %lld of %d ticks were idle", idle, SLEEP_TICKS);
+  msg ("More than half of the ticks were idle.");
+  if (switches > (SLEEPER_CNT + 1) * SWITCHES_PER_SLEEPER)
+    fail ("%lld context switches while sleeping", switches);
+  msg ("Sleeping threads caused few context switches.");
+}
+
+/* Keeps the main thread busy while the others sleep and checks
+   that the sleepers never take the CPU away from it. */
+void
+test_alarm_spin (void) 
+{
+  struct semaphore done;
+  long long switches;
+  int64_t start;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  msg ("Spinning for %d ticks while %d threads sleep.",
+       SLEEP_TICKS / 2, SLEEPER_CNT);
+  start_sleepers (&done);
+  timer_sleep (1);
+  switches = thread_switch_cnt ();
+  start = timer_ticks ();
+  while (timer_elapsed (start) < SLEEP_TICKS / 2)
+    continue;
+  switches = thread_switch_cnt () - switches;
+  wait_sleepers (&done);
+
+  if (switches > SWITCHES_PER_SLEEPER)
+    fail ("%lld context switches while spinning", switches);
+  msg ("Sleeping threads did not preempt the spinning thread.");
+}
+
+/* Starts SLEEPER_CNT threads that sleep SLEEP_TICKS ticks and
+   then up DONE. */
+static void
+start_sleepers (struct semaphore *done) 
+{
+  int i;
+
+  sema_init (done, 0);
+  for (i = 0; i < SLEEPER_CNT; i++) 
+    {
+      char name[16];
+      snprintf (name, sizeof name, "sleeper %d", i);
+      thread_create (name, PRI_DEFAULT, sleeper, done);
+    }
+}
+
+/* Waits for all the sleepers started on DONE to finish. */
+static void
+wait_sleepers (struct semaphore *done) 
+{
+  int i;
+
+  for (i = 0; i < SLEEPER_CNT; i++)
+    sema_down (done);
+}
+
+/* Sleeper thread. */
+static void
+sleeper (void *done_) 
+{
+  struct semaphore *done = done_;
+
+  timer_sleep (SLEEP_TICKS);
+  sema_up (done);
+}
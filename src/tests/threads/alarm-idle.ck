@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-idle) begin
+(alarm-idle) Putting 10 threads and the main thread to sleep for 100 ticks.
+(alarm-idle) More than half of the ticks were idle.
+(alarm-idle) Sleeping threads caused few context switches.
+(alarm-idle) end
+EOF
+pass;
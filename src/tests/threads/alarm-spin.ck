@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-spin) begin
+(alarm-spin) Spinning for 50 ticks while 10 threads sleep.
+(alarm-spin) Sleeping threads did not preempt the spinning thread.
+(alarm-spin) end
+EOF
+pass;
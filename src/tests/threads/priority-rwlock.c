@@ -0,0 +1,53 @@
+/* Tests that a reader-writer lock prefers writers and lets the
+   highest-priority waiting writer in first.  The main thread
+   holds the lock for reading while two writers and a reader line
+   up behind it.  The reader must wait for both writers, even
+   though it has the highest priority of all, and the writers must
+   go in priority order. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func reader_thread;
+static thread_func writer_thread;
+static struct rwlock rwlock;
+
+void
+test_priority_rwlock (void) 
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  rwlock_init (&rwlock);
+  rwlock_acquire_read (&rwlock);
+  thread_create ("writer 32", PRI_DEFAULT + 1, writer_thread, NULL);
+  thread_create ("reader 34", PRI_DEFAULT + 3, reader_thread, NULL);
+  thread_create ("writer 33", PRI_DEFAULT + 2, writer_thread, NULL);
+  msg ("Main thread releasing the read lock.");
+  rwlock_release_read (&rwlock);
+  msg ("Main thread finished.");
+}
+
+static void
+reader_thread (void *aux UNUSED) 
+{
+  msg ("Thread %s waiting.", thread_name ());
+  rwlock_acquire_read (&rwlock);
+  msg ("Thread %s got the lock.", thread_name ());
+  rwlock_release_read (&rwlock);
+}
+
+static void
+writer_thread (void *aux UNUSED) 
+{
+  msg ("Thread %s waiting.", thread_name ());
+  rwlock_acquire_write (&rwlock);
+  msg ("Thread %s got the lock.", thread_name ());
+  rwlock_release_write (&rwlock);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-rwlock) begin
+(priority-rwlock) Thread writer 32 waiting.
+(priority-rwlock) Thread reader 34 waiting.
+(priority-rwlock) Thread writer 33 waiting.
+(priority-rwlock) Main thread releasing the read lock.
+(priority-rwlock) Thread writer 33 got the lock.
+(priority-rwlock) Thread writer 32 got the lock.
+(priority-rwlock) Thread reader 34 got the lock.
+(priority-rwlock) Main thread finished.
+(priority-rwlock) end
+EOF
+pass;
@@ -0,0 +1,33 @@
+/* Opens the same file many times, which must hand out the lowest
+   free file descriptor each time, and checks that a closed
+   descriptor is handed out again before any higher one. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define OPEN_CNT 200
+
+void
+test_main (void) 
+{
+  int fds[OPEN_CNT];
+  int i;
+
+  for (i = 0; i < OPEN_CNT; i++)
+    {
+      fds[i] = open ("sample.txt");
+      if (fds[i] < 2)
+        fail ("open #%d returned %d", i, fds[i]);
+      if (i > 0 && fds[i] != fds[i - 1] + 1)
+        fail ("open #%d returned %d after %d", i, fds[i], fds[i - 1]);
+    }
+  msg ("opened \"sample.txt\" %d times", OPEN_CNT);
+
+  close (fds[150]);
+  close (fds[10]);
+  CHECK (open ("sample.txt") == fds[10], "lowest closed fd is reused");
+  CHECK (open ("sample.txt") == fds[150], "next closed fd is reused");
+  CHECK (open ("sample.txt") == fds[OPEN_CNT - 1] + 1,
+         "then the fd after the highest");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(open-many) begin
+(open-many) opened "sample.txt" 200 times
+(open-many) lowest closed fd is reused
+(open-many) next closed fd is reused
+(open-many) then the fd after the highest
+(open-many) end
+open-many: exit(0)
+EOF
+pass;
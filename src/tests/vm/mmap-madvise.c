@@ -0,0 +1,41 @@
+/* Gives access hints for a mapping, then verifies that the data
+   read through it is intact and that writes dropped by
+   MADV_DONTNEED still reach the file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+  char buf[1024];
+
+  CHECK (create ("sample.txt", strlen (sample)), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  CHECK (madvise (ACTUAL, strlen (sample), MADV_SEQUENTIAL),
+         "madvise MADV_SEQUENTIAL");
+  CHECK (madvise (ACTUAL, strlen (sample), MADV_WILLNEED),
+         "madvise MADV_WILLNEED");
+  memcpy (ACTUAL, sample, strlen (sample));
+  CHECK (madvise (ACTUAL, strlen (sample), MADV_DONTNEED),
+         "madvise MADV_DONTNEED");
+  CHECK (!memcmp (ACTUAL, sample, strlen (sample)),
+         "compare mapped data against written data");
+
+  /* Read back via read(). */
+  read (handle, buf, strlen (sample));
+  CHECK (!memcmp (buf, sample, strlen (sample)),
+         "compare read data against written data");
+  CHECK (!madvise ((char *) ACTUAL + 1, 4096, MADV_DONTNEED),
+         "madvise misaligned address");
+  munmap (map);
+  close (handle);
+}
@@ -0,0 +1,61 @@
+/* Forks after filling a data area and verifies that the child sees
+   the parent's values, and that the stores either process makes
+   afterwards are not seen by the other. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 4096)
+
+static char buf[SIZE];
+
+static void
+check_buf (const char *who, int salt)
+{
+  size_t i;
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (char) (i % 251 + salt))
+      fail ("%s: byte %zu != %d", who, i, (int) (char) (i % 251 + salt));
+}
+
+static void
+fill_buf (int salt)
+{
+  size_t i;
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i % 251 + salt;
+}
+
+void
+test_main (void)
+{
+  int value = 42;
+  pid_t pid;
+
+  fill_buf (0);
+  pid = fork ();
+  if (pid == 0)
+    {
+      check_buf ("child", 0);
+      if (value != 42)
+        fail ("child: stack value %d != 42", value);
+      msg ("child read pass");
+      fill_buf (1);
+      value = 0;
+      check_buf ("child", 1);
+      msg ("child write pass");
+      exit (81);
+    }
+  if (pid < 0)
+    fail ("fork");
+  CHECK (wait (pid) == 81, "wait for child");
+  check_buf ("parent", 0);
+  if (value != 42)
+    fail ("parent: stack value %d != 42", value);
+  msg ("parent read pass");
+  fill_buf (2);
+  check_buf ("parent", 2);
+  msg ("parent write pass");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-fork) begin
+(page-fork) child read pass
+(page-fork) child write pass
+(page-fork) wait for child
+(page-fork) parent read pass
+(page-fork) parent write pass
+(page-fork) end
+EOF
+pass;
@@ -0,0 +1,34 @@
+/* Writes a buffer spanning many pages to a file and reads it back
+   while the resident limit is lower than the pages a single read or
+   write pins, and verifies the data. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (40 * 4096)
+
+static char src[SIZE];
+static char dst[SIZE];
+
+void
+test_main (void)
+{
+  size_t i;
+  int fd;
+
+  for (i = 0; i < SIZE; i++)
+    src[i] = i % 253;
+  CHECK (create ("pinned", SIZE), "create \"pinned\"");
+  CHECK ((fd = open ("pinned")) > 1, "open \"pinned\"");
+  CHECK (set_rss_limit (8), "set_rss_limit 8");
+  CHECK (write (fd, src, SIZE) == SIZE, "write \"pinned\"");
+  seek (fd, 0);
+  CHECK (read (fd, dst, SIZE) == SIZE, "read \"pinned\"");
+  if (memcmp (src, dst, SIZE))
+    fail ("data read back differs");
+  msg ("compare pass");
+  CHECK (set_rss_limit (0), "set_rss_limit 0");
+  close (fd);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-pin) begin
+(page-pin) create "pinned"
+(page-pin) open "pinned"
+(page-pin) set_rss_limit 8
+(page-pin) write "pinned"
+(page-pin) read "pinned"
+(page-pin) compare pass
+(page-pin) set_rss_limit 0
+(page-pin) end
+EOF
+pass;
@@ -0,0 +1,40 @@
+/* Limits the resident memory of the process, touches more pages
+   than the limit allows and verifies that they keep their values
+   while the process stays within its limit. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define LIMIT 32
+#define SIZE (128 * 4096)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  struct memstat stat;
+  size_t i;
+
+  CHECK (!set_rss_limit (-1), "set_rss_limit rejects negative limit");
+  CHECK (set_rss_limit (LIMIT), "set_rss_limit %d", LIMIT);
+
+  msg ("write pass");
+  for (i = 0; i < SIZE; i += 4096)
+    memset (buf + i, i / 4096, 4096);
+
+  CHECK (memstat (&stat), "memstat");
+  if (stat.rss_limit != LIMIT)
+    fail ("rss_limit %d != %d", stat.rss_limit, LIMIT);
+  if (stat.rss > LIMIT)
+    fail ("rss %d above limit %d", stat.rss, LIMIT);
+
+  msg ("read pass");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (char) (i / 4096))
+      fail ("byte %zu != %d", i, (int) (char) (i / 4096));
+
+  CHECK (set_rss_limit (0), "set_rss_limit 0");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-rss) begin
+(page-rss) set_rss_limit rejects negative limit
+(page-rss) set_rss_limit 32
+(page-rss) write pass
+(page-rss) memstat
+(page-rss) read pass
+(page-rss) set_rss_limit 0
+(page-rss) end
+EOF
+pass;
@@ -0,0 +1,81 @@
+/* Measures random access throughput over a 4 MB block kept to 4 KB
+   pages and over one which may be mapped as a single superpage,
+   then verifies that both blocks hold the values written.  The
+   timings are informational, only the data is checked. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK (4 * 1024 * 1024)
+#define PAGE 4096
+#define ACCESSES (256 * 1024)
+
+/* Three blocks, so two aligned ones fit in between. */
+static char buf[3 * BLOCK];
+
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Writes every page of BLOCK, then reads random bytes of it.
+   Returns the cycles taken by the reads. */
+static uint64_t
+run (char *block)
+{
+  uint32_t seed = 0x2545f491;
+  unsigned sum = 0;
+  uint64_t start;
+  size_t i;
+
+  for (i = 0; i < BLOCK; i += PAGE)
+    memset (block + i, i / PAGE, PAGE);
+  start = rdtsc ();
+  for (i = 0; i < ACCESSES; i++)
+    {
+      seed = seed * 1103515245 + 12345;
+      sum += block[seed % BLOCK];
+    }
+  /* Keep the reads from being optimized away. */
+  if (sum == 0xffffffff)
+    msg ("unlikely sum");
+  return rdtsc () - start;
+}
+
+static void
+verify (const char *block, const char *name)
+{
+  size_t i;
+  for (i = 0; i < BLOCK; i++)
+    if (block[i] != (char) (i / PAGE))
+      fail ("%s block: byte %zu != %d", name, i, (int) (char) (i / PAGE));
+}
+
+void
+test_main (void)
+{
+  char *small = (char *) (((uintptr_t) buf + BLOCK - 1) & ~(BLOCK - 1));
+  char *large = small + BLOCK;
+  uint64_t small_cycles, large_cycles;
+
+  CHECK (madvise (small, BLOCK, MADV_NOHUGEPAGE), "madvise MADV_NOHUGEPAGE");
+  CHECK (madvise (large, BLOCK, MADV_HUGEPAGE), "madvise MADV_HUGEPAGE");
+
+  msg ("random access pass");
+  small_cycles = run (small);
+  large_cycles = run (large);
+  msg ("4 KB pages: %llu cycles per 1024 accesses",
+          small_cycles / (ACCESSES / 1024));
+  msg ("4 MB pages: %llu cycles per 1024 accesses",
+          large_cycles / (ACCESSES / 1024));
+
+  msg ("verify pass");
+  verify (small, "4 KB");
+  verify (large, "4 MB");
+}
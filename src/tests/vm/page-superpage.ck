@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The timings differ from run to run.
+@output = grep (!/^\(page-superpage\) 4 [KM]B pages: \d+ cycles/, @output);
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
+(page-superpage) begin
+(page-superpage) madvise MADV_NOHUGEPAGE
+(page-superpage) madvise MADV_HUGEPAGE
+(page-superpage) random access pass
+(page-superpage) verify pass
+(page-superpage) end
+EOF
+pass;
@@ -0,0 +1,37 @@
+/* Touches untouched zero filled pages and verifies that vmtrace()
+   reports a zero fill fault for each of them. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 8
+
+static char buf[(PAGE_CNT + 2) * 4096];
+static struct vmtrace_event events[64];
+
+void
+test_main (void)
+{
+  char *first = (char *) (((unsigned) buf + 4095) & ~4095u);
+  int cnt, i, page, found = 0;
+
+  for (page = 0; page < PAGE_CNT; page++)
+    first[page * 4096] = page;
+  CHECK ((cnt = vmtrace (events, 64)) > 0, "vmtrace");
+
+  for (i = 0; i < cnt; i++)
+    {
+      if (events[i].type < 0 || events[i].type >= VM_FAULT_TYPE_CNT)
+        fail ("event %d has bad type %d", i, events[i].type);
+      for (page = 0; page < PAGE_CNT; page++)
+        if (events[i].addr == first + page * 4096
+            && events[i].type == VM_FAULT_ZERO)
+          found++;
+    }
+  if (found != PAGE_CNT)
+    fail ("%d zero fill faults traced, expected %d", found, PAGE_CNT);
+  msg ("zero fill faults traced");
+  CHECK (vmtrace (events, 0) == 0, "vmtrace of no events");
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-trace) begin
+(page-trace) vmtrace
+(page-trace) zero fill faults traced
+(page-trace) vmtrace of no events
+(page-trace) end
+EOF
+pass;
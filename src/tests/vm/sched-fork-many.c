@@ -0,0 +1,42 @@
+/* Forks waves of short-lived children and reaps them all, which
+   stresses process exit and wait.  The cost of each exit with
+   interrupts off shows in the "Exit:" line of the statistics
+   printed at shutdown. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define WAVE_CNT 8
+#define CHILD_CNT 16
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  int wave, i;
+
+  for (wave = 0; wave < WAVE_CNT; wave++)
+    {
+      for (i = 0; i < CHILD_CNT; i++)
+        {
+          children[i] = fork ();
+          if (children[i] == 0)
+            exit (wave * CHILD_CNT + i);
+          if (children[i] < 0)
+            fail ("fork %d in wave %d", i, wave);
+        }
+      /* Reap in reverse so that most children have exited, and
+         left only an exit record, by the time they are waited. */
+      for (i = CHILD_CNT - 1; i >= 0; i--)
+        if (wait (children[i]) != wave * CHILD_CNT + i)
+          fail ("wrong exit code for child %d in wave %d", i, wave);
+    }
+  msg ("reaped %d children", WAVE_CNT * CHILD_CNT);
+
+  /* Orphans: exit without waiting for the last wave. */
+  for (i = 0; i < CHILD_CNT; i++)
+    if (fork () == 0)
+      exit (0);
+  msg ("left %d children unwaited", CHILD_CNT);
+}
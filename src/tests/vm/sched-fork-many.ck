@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sched-fork-many) begin
+(sched-fork-many) reaped 128 children
+(sched-fork-many) left 16 children unwaited
+(sched-fork-many) end
+EOF
+pass;
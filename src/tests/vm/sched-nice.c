@@ -0,0 +1,34 @@
+/* Changes the niceness of the process with nice() and verifies
+   that it is clamped to NICE_MIN...NICE_MAX and that a forked
+   child inherits it. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  pid_t pid;
+
+  CHECK (nice (0) == 0, "nice starts at 0");
+  CHECK (nice (5) == 5, "nice 5");
+  CHECK (nice (-2) == 3, "nice -2");
+  CHECK (nice (100) == NICE_MAX, "nice is capped at NICE_MAX");
+  CHECK (nice (-100) == NICE_MIN, "nice is capped at NICE_MIN");
+  CHECK (nice (NICE_MAX / 2 - NICE_MIN) == NICE_MAX / 2, "nice back to 10");
+  CHECK (get_load_avg () >= 0, "load average is not negative");
+  CHECK (get_recent_cpu () >= 0, "recent cpu is not negative");
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      if (nice (0) != NICE_MAX / 2)
+        fail ("child: nice %d != %d", nice (0), NICE_MAX / 2);
+      msg ("child inherited nice");
+      exit (0);
+    }
+  if (pid < 0)
+    fail ("fork");
+  CHECK (wait (pid) == 0, "wait for child");
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sched-nice) begin
+(sched-nice) nice starts at 0
+(sched-nice) nice 5
+(sched-nice) nice -2
+(sched-nice) nice is capped at NICE_MAX
+(sched-nice) nice is capped at NICE_MIN
+(sched-nice) nice back to 10
+(sched-nice) load average is not negative
+(sched-nice) recent cpu is not negative
+(sched-nice) child inherited nice
+(sched-nice) wait for child
+(sched-nice) end
+EOF
+pass;
@@ -41,11 +41,16 @@
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #include "vm/swap.h"
+#include "vm/zswap.h"
+#include "vm/clock.h"
+#include "vm/region.h"
+#include "vm/trace.h"
 #endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *base_page_dir;
 bool base_page_dir_initialized = 0;
+bool paging_pse;
 
 #ifdef FILESYS
 /* -f: Format the file system? */
@@ -68,6 +73,7 @@ static bool reboot_when_done;
 
 static void bss_init (void);
 static void paging_init (void);
+static bool cpu_has_pse (void);
 static void pci_zone_init (void);
 
 static char **read_command_line (void);
@@ -113,6 +119,8 @@ main (void)
   frame_init ();
   sframe_init();
   init_mmap ();
+  region_superpage_init ();
+  vm_trace_init ();
   /* Segmentation. */
 #ifdef USERPROG
   tss_init ();
@@ -128,6 +136,7 @@ main (void)
 #ifdef USERPROG
   exception_init ();
   syscall_init ();
+  process_init ();
 #endif
 
   /* Start thread scheduler and enable interrupts. */
@@ -144,6 +153,7 @@ main (void)
   filesys_init (format_filesys);
   thread_filesys_init ();
   swap_init();
+  vm_mmap_writer_init ();
 #endif
 
   printf ("Boot complete.\n");
@@ -176,7 +186,8 @@ bss_init (void)
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points base_page_dir to the page
-   directory it creates. */
+   directory it creates.  If the CPU supports it, every 4 MB of
+   RAM clear of the kernel text is mapped as one superpage. */
 static void
 paging_init (void)
 {
@@ -184,6 +195,14 @@ paging_init (void)
   size_t page;
   extern char _start, _end_kernel_text;
 
+  if (cpu_has_pse ())
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PSE));
+      paging_pse = true;
+    }
+
   pd = base_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
   for (page = 0; page < ram_pages; page++) 
@@ -194,6 +213,14 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (paging_pse && pte_idx == 0 && page + SUPERPAGE_PAGES <= ram_pages
+          && (vaddr + SUPERPAGE_SIZE <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_super_kernel (vaddr, true);
+          page += SUPERPAGE_PAGES - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -215,6 +242,16 @@ paging_init (void)
   base_page_dir_initialized = 1;
 }
 
+/* Returns true if the CPU supports 4 MB pages, as reported by
+   CPUID.  See [IA32-v2a] "CPUID--CPU Identification". */
+static bool
+cpu_has_pse (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return (edx & (1 << 3)) != 0;
+}
+
 /* initialize PCI zone at PCI_ADDR_ZONE_BEGIN - PCI_ADDR_ZONE_END*/
 static void
 pci_zone_init (void)
@@ -294,6 +331,8 @@ parse_options (char **argv)
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
+      else if (!strcmp (name, "-vmtrace"))
+        vm_trace_dump = true;
 #endif
 #endif
       else if (!strcmp (name, "-rs"))
@@ -303,6 +342,8 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+      else if (!strcmp (name, "-fdl"))
+        fd_limit = atoi (value);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -419,12 +460,14 @@ usage (void)
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -vmtrace           Print the recent page faults at shutdown.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+          "  -fdl=COUNT         Allow each process COUNT open files.\n"
 #endif
           );
   power_off ();
@@ -545,4 +588,12 @@ print_stats (void)
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+#ifdef VM
+  page_print_stats ();
+  swap_print_stats ();
+  zswap_print_stats ();
+  evict_print_stats ();
+  region_print_stats ();
+  vm_trace_print_stats ();
+#endif
 }
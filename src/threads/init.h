@@ -10,6 +10,9 @@
 /* Page directory with kernel mappings only. */
 extern uint32_t *base_page_dir;
 
+/* Can page directories map 4 MB superpages? */
+extern bool paging_pse;
+
 /* -q: Power off when kernel tasks complete? */
 extern bool power_off_when_done;
 
@@ -57,6 +57,11 @@ static uint8_t pic_mask[2];
 static bool in_external_intr;   /* Are we processing an external interrupt? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
+/* Interrupts-off timing, see intr_watch(). */
+static struct thread *intr_watcher; /* Thread whose stretches are timed. */
+static uint64_t intr_off_start;   /* Time stamp interrupts went off. */
+static uint64_t intr_off_longest; /* Longest stretch timed, in cycles. */
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
@@ -65,6 +70,7 @@ static void pic_end_of_interrupt (int irq);
 static uint64_t make_intr_gate (void (*) (void), int dpl);
 static uint64_t make_trap_gate (void (*) (void), int dpl);
 static inline uint64_t make_idtr_operand (uint16_t limit, void *base);
+static bool intr_watched (void);
 
 /* Interrupt handlers. */
 void intr_handler (struct intr_frame *args);
@@ -99,6 +105,13 @@ intr_enable (void)
   enum intr_level old_level = intr_get_level ();
   ASSERT (!intr_context ());
 
+  if (old_level == INTR_OFF && intr_watched ())
+    {
+      uint64_t off = rdtsc () - intr_off_start;
+      if (off > intr_off_longest)
+        intr_off_longest = off;
+    }
+
   /* Enable interrupts by setting the interrupt flag.
 
      See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
@@ -118,9 +131,56 @@ intr_disable (void)
      See [IA32-v2b] "CLI" and [IA32-v3a] 5.8.1 "Masking Maskable
      Hardware Interrupts". */
   asm volatile ("cli" : : : "memory");
+  if (old_level == INTR_ON && intr_watched ())
+    intr_off_start = rdtsc ();
 
   return old_level;
 }
+
+/* Starts or stops timing the stretches for which the current
+   thread turns interrupts off. Only its own stretches outside of
+   external interrupts count, not those of the threads that run
+   while it sleeps. Stretches ended by intr_enable() while timing
+   are kept track of by intr_watch_longest(). */
+void
+intr_watch (bool on)
+{
+  intr_watcher = on ? thread_current () : NULL;
+}
+
+/* Restarts the timing of the current stretch with interrupts off
+   when the thread timed by intr_watch() is switched back in, so
+   that the time it slept does not count. Called by
+   schedule_tail(). */
+void
+intr_watch_resume (void)
+{
+  if (intr_watched ())
+    intr_off_start = rdtsc ();
+}
+
+/* Returns true if the running thread is the one being timed by
+   intr_watch(), outside of an external interrupt. Reads the stack
+   pointer rather than calling thread_current(), which asserts the
+   thread is running, as it is not while it is being switched. */
+static bool
+intr_watched (void)
+{
+  uint32_t *esp;
+
+  if (intr_watcher == NULL || in_external_intr)
+    return false;
+  asm ("mov %%esp, %0" : "=g" (esp));
+  return pg_round_down (esp) == intr_watcher;
+}
+
+/* Returns the longest stretch timed by intr_watch() with interrupts
+   off, in processor cycles. */
+uint64_t
+intr_watch_longest (void)
+{
+  return intr_off_longest;
+}
 
 /* Initializes the interrupt system. */
 void
@@ -366,6 +426,10 @@ intr_handler (struct intr_frame *frame)
 
   external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
 
+  /* Interrupt gates turned interrupts off on the way in. */
+  if (!external && intr_get_level () == INTR_OFF && intr_watched ())
+    intr_off_start = rdtsc ();
+
 /*   if (intr_get_level() == INTR_ON)*/
 /*   	printf("Interrupts are ON while handling %s :: external : %d\n", intr_name(frame->vec_no), external);*/
 /* 	else //if (frame->vec_no != 32 && frame->vec_no != 36 && frame->vec_no != 46)*/
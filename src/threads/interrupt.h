@@ -16,6 +16,18 @@ enum intr_level intr_get_level (void);
 enum intr_level intr_set_level (enum intr_level);
 enum intr_level intr_enable (void);
 enum intr_level intr_disable (void);
+void intr_watch (bool on);
+void intr_watch_resume (void);
+uint64_t intr_watch_longest (void);
+
+/* Returns the processor's time stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
 
 /* Interrupt stack frame. */
 struct intr_frame
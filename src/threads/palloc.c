@@ -103,6 +103,55 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   return pages;
 }
 
+/* Obtains PAGE_CNT contiguous free pages like
+   palloc_get_multiple(), starting at a physical address which is a
+   multiple of ALIGN pages. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt, size_t align)
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  void *pages = NULL;
+  size_t base_no = vtop (pool->base) / PGSIZE;
+  size_t page_idx;
+
+  ASSERT (align > 0);
+  if (page_cnt == 0)
+    return NULL;
+
+  lock_acquire (&pool->lock);
+  for (page_idx = (align - base_no % align) % align;
+       page_idx + page_cnt <= bitmap_size (pool->used_map);
+       page_idx += align)
+    if (bitmap_none (pool->used_map, page_idx, page_cnt))
+      {
+        bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+        pages = pool->base + PGSIZE * page_idx;
+        break;
+      }
+  lock_release (&pool->lock);
+
+  if (pages != NULL) 
+    {
+      if (flags & PAL_ZERO)
+        memset (pages, 0, PGSIZE * page_cnt);
+    }
+  else 
+    {
+      if (flags & PAL_ASSERT)
+        PANIC ("palloc_get: out of pages");
+    }
+
+  return pages;
+}
+
+/* Returns the number of pages in the pool FLAGS selects. */
+size_t
+palloc_page_cnt (enum palloc_flags flags)
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  return bitmap_size (pool->used_map);
+}
+
 /* Obtains a single free page and returns its kernel virtual
    address.
    If PAL_USER is set, the page is obtained from the user pool,
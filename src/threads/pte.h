@@ -77,8 +77,17 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_CD (1 << 4)         /* 1=cache disabled, 0=cache enabled. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80             /* 1=4 MB page, 0=page table (PDEs only). */
 #define PTE_G (1 << 8)          /* 1=global page, do not flush */
 
+/* A PDE with PTE_PS set maps a 4 MB superpage directly, which needs
+   the page size extension turned on in CR4. The superpage must be
+   4 MB aligned in physical memory. See [IA32-v3a] 3.7.3 "Mixing
+   4-KByte and 4-MByte Pages". */
+#define CR4_PSE (1 << 4)                   /* Page size extension. */
+#define SUPERPAGE_SIZE PTSPAN              /* Bytes in a superpage. */
+#define SUPERPAGE_PAGES (PTSPAN / PGSIZE)  /* Pages in a superpage. */
+
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create_user (uint32_t *pt) {
   ASSERT (pg_ofs (pt) == 0);
@@ -91,10 +100,32 @@ static inline uint32_t pde_create_kernel (uint32_t *pt) {
   return vtop (pt) | PTE_P | PTE_W | PTE_G;
 }
 
+/* Returns a PDE that maps the superpage at kernel address PAGE.
+   The superpage will be usable only by ring 0 code. */
+static inline uint32_t pde_create_super_kernel (void *page, bool writable) {
+  ASSERT (vtop (page) % SUPERPAGE_SIZE == 0);
+  return vtop (page) | PTE_P | PTE_PS | (writable ? PTE_W : 0) | PTE_G;
+}
+
+/* Returns a PDE that maps the superpage at kernel address PAGE.
+   The superpage will be usable by both user and kernel code. */
+static inline uint32_t pde_create_super_user (void *page, bool writable) {
+  ASSERT (vtop (page) % SUPERPAGE_SIZE == 0);
+  return vtop (page) | PTE_P | PTE_PS | (writable ? PTE_W : 0) | PTE_U;
+}
+
+/* Returns a pointer to the superpage that page directory entry
+   PDE, which must map a superpage, points to. */
+static inline void *pde_get_super (uint32_t pde) {
+  ASSERT (pde & PTE_PS);
+  return ptov (pde & ~(uint32_t) (SUPERPAGE_SIZE - 1));
+}
+
 /* Returns a pointer to the page table that page directory entry
    PDE, which must "present", points to. */
 static inline uint32_t *pde_get_pt (uint32_t pde) {
   ASSERT (pde & PTE_P);
+  ASSERT (!(pde & PTE_PS));
   return ptov (pde & PTE_ADDR);
 }
 
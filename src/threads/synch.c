@@ -103,7 +103,8 @@ sema_try_down (struct semaphore *sema)
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest priority thread of those waiting for
+   SEMA, if any, yielding to it if it outranks the running thread.
 
    This function may be called from an interrupt handler. */
 void
@@ -115,10 +116,15 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
   if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      struct list_elem *e = list_max (&sema->waiters,
+                                      thread_priority_less, NULL);
+      list_remove (e);
+      thread_unblock (list_entry (e, struct thread, elem));
+    }
   sema->value++;
   intr_set_level (old_level);
+  thread_yield_to_higher ();
 }
 
 static void sema_test_helper (void *sema_);
@@ -186,6 +192,10 @@ lock_init (struct lock *lock)
    necessary.  The lock must not already be held by the current
    thread.
 
+   While waiting, the current thread donates its priority to the
+   holder, and on down the chain of locks the holder is waiting
+   for, at most DONATION_DEPTH_MAX locks deep.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -193,13 +203,34 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
-  
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  if (lock->holder != NULL && !thread_mlfqs)
+    {
+      struct thread *t = cur;
+      struct lock *l = lock;
+      int depth;
+
+      cur->waiting_lock = lock;
+      for (depth = 0; depth < DONATION_DEPTH_MAX && l != NULL
+                      && l->holder != NULL; depth++)
+        {
+          thread_donate_priority (l->holder, t->priority);
+          t = l->holder;
+          l = t->waiting_lock;
+        }
+    }
   sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  cur->waiting_lock = NULL;
+  lock->holder = cur;
+  list_push_back (&cur->held_locks, &lock->elem);
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -211,18 +242,25 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock->holder = thread_current ();
+      list_push_back (&thread_current ()->held_locks, &lock->elem);
+    }
+  intr_set_level (old_level);
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Priority donated through LOCK is given back, so this may yield.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -230,11 +268,17 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  list_remove (&lock->elem);
   lock->holder = NULL;
   sema_up (&lock->semaphore);
+  intr_set_level (old_level);
+  thread_refresh_priority ();
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -253,8 +297,12 @@ struct semaphore_elem
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
   };
 
+static bool waiter_priority_less (const struct list_elem *,
+                                  const struct list_elem *, void *aux);
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -297,6 +345,7 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
   list_push_back (&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
@@ -304,7 +353,8 @@ cond_wait (struct condition *cond, struct lock *lock)
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
+   this function signals the highest priority one to wake up from
+   its wait.
    LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -319,8 +369,23 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      struct list_elem *e = list_max (&cond->waiters,
+                                      waiter_priority_less, NULL);
+      list_remove (e);
+      sema_up (&list_entry (e, struct semaphore_elem, elem)->semaphore);
+    }
+}
+
+/* Orders condition variable waiters by the priority of their
+   threads. */
+static bool
+waiter_priority_less (const struct list_elem *a_,
+                      const struct list_elem *b_, void *aux UNUSED)
+{
+  const struct semaphore_elem *a = list_entry (a_, struct semaphore_elem, elem);
+  const struct semaphore_elem *b = list_entry (b_, struct semaphore_elem, elem);
+  return a->thread->priority < b->thread->priority;
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -338,3 +403,107 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes RWLOCK.  A reader-writer lock may be held by any
+   number of readers at once or by a single writer.
+
+   Writers are preferred: once a writer is waiting, new readers
+   wait behind it, so a steady stream of readers cannot starve
+   writers.  When a writer releases the lock, the highest priority
+   waiting writer goes next if there is one, otherwise all waiting
+   readers are let in together.
+
+   A thread must not acquire RWLOCK for reading while it already
+   holds it for reading, since a writer arriving in between would
+   deadlock them.  Neither kind of holder receives priority
+   donations. */
+void
+rwlock_init (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_init (&rwlock->lock);
+  cond_init (&rwlock->readers_ok);
+  cond_init (&rwlock->writers_ok);
+  rwlock->readers = 0;
+  rwlock->waiting_writers = 0;
+  rwlock->writer = NULL;
+}
+
+/* Acquires RWLOCK for reading, sleeping while a writer holds or
+   is waiting for it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+  ASSERT (!rwlock_held_by_current_thread (rwlock));
+
+  lock_acquire (&rwlock->lock);
+  while (rwlock->writer != NULL || rwlock->waiting_writers > 0)
+    cond_wait (&rwlock->readers_ok, &rwlock->lock);
+  rwlock->readers++;
+  lock_release (&rwlock->lock);
+}
+
+/* Releases RWLOCK, which the current thread holds for reading.
+   The last reader out lets a waiting writer in. */
+void
+rwlock_release_read (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_acquire (&rwlock->lock);
+  ASSERT (rwlock->readers > 0);
+  if (--rwlock->readers == 0 && rwlock->waiting_writers > 0)
+    cond_signal (&rwlock->writers_ok, &rwlock->lock);
+  lock_release (&rwlock->lock);
+}
+
+/* Acquires RWLOCK for writing, sleeping until no other thread
+   holds it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+  ASSERT (!rwlock_held_by_current_thread (rwlock));
+
+  lock_acquire (&rwlock->lock);
+  rwlock->waiting_writers++;
+  while (rwlock->writer != NULL || rwlock->readers > 0)
+    cond_wait (&rwlock->writers_ok, &rwlock->lock);
+  rwlock->waiting_writers--;
+  rwlock->writer = thread_current ();
+  lock_release (&rwlock->lock);
+}
+
+/* Releases RWLOCK, which the current thread holds for writing. */
+void
+rwlock_release_write (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+  ASSERT (rwlock_held_by_current_thread (rwlock));
+
+  lock_acquire (&rwlock->lock);
+  rwlock->writer = NULL;
+  if (rwlock->waiting_writers > 0)
+    cond_signal (&rwlock->writers_ok, &rwlock->lock);
+  else
+    cond_broadcast (&rwlock->readers_ok, &rwlock->lock);
+  lock_release (&rwlock->lock);
+}
+
+/* Returns true if the current thread holds RWLOCK for writing,
+   false otherwise. */
+bool
+rwlock_held_by_current_thread (const struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  return rwlock->writer == thread_current ();
+}
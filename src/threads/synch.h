@@ -21,8 +21,9 @@ void sema_self_test (void);
 /* Lock. */
 struct lock 
   {
-    struct thread *holder;      /* Thread holding lock (for debugging). */
+    struct thread *holder;      /* Thread holding lock. */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in the holder's held_locks. */
   };
 
 void lock_init (struct lock *);
@@ -42,6 +43,24 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Reader-writer lock. */
+struct rwlock
+  {
+    struct lock lock;           /* Protects the members below. */
+    struct condition readers_ok; /* Signaled when readers may enter. */
+    struct condition writers_ok; /* Signaled when a writer may enter. */
+    int readers;                /* # of threads holding it shared. */
+    int waiting_writers;        /* # of threads waiting to write. */
+    struct thread *writer;      /* Thread holding it exclusively. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_by_current_thread (const struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -13,7 +13,6 @@
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
-#include "../lib/kernel/bitmap.h"
 #include "filesys/file.h"
 #include "filesys/bcache.h"
 #include "devices/timer.h"
@@ -31,17 +30,33 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Fills the unused part of a new thread's kernel stack, so that
+   thread_stack_high_water() can tell how deep it has been. */
+#define STACK_POISON 0xa5
+
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running, in one FIFO queue per
+   priority.  Bit P of ready_mask is set when ready_queues[P] is
+   not empty, so the highest ready priority is one bit scan away. */
+#define READY_MASK_WORDS ((PRI_MAX + 32) / 32)
+static struct list ready_queues[PRI_MAX + 1];
+static uint32_t ready_mask[READY_MASK_WORDS];
+static int ready_cnt;           /* # of threads in ready_queues. */
+
+/* System load average, for the MLFQS. */
+static fixed_t load_avg;
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
-/* List of all the dead processes's EXIT_THREAD. An EXIT_THREAD structure
-   is added to this list after the process's memory has been freed */
-static struct list dead_list;
+/* Live threads and the EXIT_THREADs of dead processes not yet
+   waited for, hashed by tid into TID_HASH_BUCKETS chains each.  An
+   EXIT_THREAD is also on its parent's exited_children list.  Tids
+   are never reused, so a chain holds few entries. */
+#define TID_HASH_BUCKETS 64
+static struct list thread_buckets[TID_HASH_BUCKETS];
+static struct list exit_buckets[TID_HASH_BUCKETS];
 
 /* Idle thread. */
 static struct thread *idle_thread;
@@ -64,6 +79,10 @@ struct kernel_thread_frame
 static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
+static long long switch_cnt;    /* # of switches between threads. */
+static long long exit_cnt;      /* # of threads exited. */
+static long long exit_cycles;   /* Cycles spent exiting with interrupts off. */
+static size_t stack_high_water; /* Deepest kernel stack of exited threads. */
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
@@ -79,14 +98,22 @@ static void kernel_thread (thread_func *, void *aux);
 static void idle (void *aux UNUSED);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static int ready_max_priority (void);
+static void mlfqs_tick (struct thread *);
+static void mlfqs_update_recent_cpu (struct thread *, void *aux);
+static void mlfqs_update_priority (struct thread *, void *aux);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void schedule_tail (struct thread *prev);
 void fd_mem_free (void);
-void thread_wakeup (void);
+void thread_wakeup (struct thread *parent);
 static tid_t allocate_tid (void);
+static void thread_hash_insert (struct thread *);
+static void stack_high_water_max (struct thread *, void *deepest);
 
 void filesys_thread (void *);
 void filesys_readahead_thread (void *);
@@ -106,18 +133,26 @@ void filesys_readahead_thread (void *);
 void
 thread_init (void) 
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (i = 0; i <= PRI_MAX; i++)
+    list_init (&ready_queues[i]);
   list_init (&all_list);
-  list_init (&dead_list);
+  for (i = 0; i < TID_HASH_BUCKETS; i++)
+    {
+      list_init (&thread_buckets[i]);
+      list_init (&exit_buckets[i]);
+    }
   
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
   init_thread (initial_thread, "main", PRI_DEFAULT);
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
+  thread_hash_insert (initial_thread);
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -158,6 +193,9 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+  if (thread_mlfqs)
+    mlfqs_tick (t);
+
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
@@ -167,8 +205,66 @@ thread_tick (void)
 void
 thread_print_stats (void) 
 {
-  printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
-          idle_ticks, kernel_ticks, user_ticks);
+  printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks, "
+          "%lld context switches\n",
+          idle_ticks, kernel_ticks, user_ticks, switch_cnt);
+  printf ("Exit: %lld threads, %lld cycles with interrupts off each\n",
+          exit_cnt, exit_cnt != 0 ? exit_cycles / exit_cnt : 0);
+
+  enum intr_level old_level = intr_disable ();
+  size_t deepest = stack_high_water;
+  thread_foreach (stack_high_water_max, &deepest);
+  intr_set_level (old_level);
+  printf ("Stack: deepest kernel stack %zu of %zu bytes\n",
+          deepest, PGSIZE - sizeof (struct thread));
+}
+
+/* Returns how many bytes of its kernel stack T has used at most
+   so far, judged by how much of the STACK_POISON written at its
+   creation has been overwritten.  The initial thread's stack was
+   not poisoned, so it reports 0. */
+size_t
+thread_stack_high_water (struct thread *t)
+{
+  const uint8_t *p = (const uint8_t *) (t + 1);
+  const uint8_t *top = (const uint8_t *) t + PGSIZE;
+
+  ASSERT (is_thread (t));
+  if (t == initial_thread)
+    return 0;
+  while (p < top && *p == STACK_POISON)
+    p++;
+  return top - p;
+}
+
+/* Raises *DEEPEST to T's stack high-water mark. */
+static void
+stack_high_water_max (struct thread *t, void *deepest_)
+{
+  size_t *deepest = deepest_;
+  size_t used = thread_stack_high_water (t);
+  if (used > *deepest)
+    *deepest = used;
+}
+
+/* Returns the number of timer ticks spent idle so far. */
+long long
+thread_idle_ticks (void)
+{
+  enum intr_level old_level = intr_disable ();
+  long long cnt = idle_ticks;
+  intr_set_level (old_level);
+  return cnt;
+}
+
+/* Returns the number of switches between threads so far. */
+long long
+thread_switch_cnt (void)
+{
+  enum intr_level old_level = intr_disable ();
+  long long cnt = switch_cnt;
+  intr_set_level (old_level);
+  return cnt;
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -183,9 +279,8 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   The new thread runs at PRIORITY.  thread_create() preempts the
+   caller if the new thread outranks it. */
 struct thread *
 thread_create_blocked (const char *name, int priority,
                thread_func *function, void *aux) 
@@ -200,12 +295,22 @@ thread_create_blocked (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = palloc_get_page (0);
   if (t == NULL)
     return NULL;
 
-  /* Initialize thread. */
+  /* Initialize thread.  Under the MLFQS, PRIORITY is ignored and
+     the thread starts out as nice and as busy as its creator. */
   init_thread (t, name, priority);
+  memset (t + 1, STACK_POISON, PGSIZE - sizeof *t);
+  t->nice = thread_current ()->nice;
+  t->recent_cpu = thread_current ()->recent_cpu;
+  if (thread_mlfqs)
+    {
+      old_level = intr_disable ();
+      mlfqs_update_priority (t, NULL);
+      intr_set_level (old_level);
+    }
   
   if(thread_current()->cwd != NULL)
     t->cwd = dir_reopen(thread_current()->cwd);
@@ -218,6 +323,7 @@ thread_create_blocked (const char *name, int priority,
      Do this atomically so intermediate values for the 'stack' 
      member cannot be observed. */
   old_level = intr_disable ();
+  thread_hash_insert (t);
   
   /* Stack frame for start_exec_process */
   if_ = alloc_frame(t, sizeof *if_);
@@ -238,17 +344,11 @@ thread_create_blocked (const char *name, int priority,
   sf->ebp = 0;
 
 #ifdef USERPROG
-  t -> fd_table = (struct list *)malloc (sizeof (struct list));
-  list_init (t -> fd_table);
-  /* Assuming 128 to be a maximum */
-  t -> fd_entry =bitmap_create (500);
-  /* setting true for initial console*/
+  /* setting true for initial console.  The fd table itself is
+     created by the first open, see fd_table_create(). */
   t -> fd_std_in = true;
   t -> fd_std_err = true;
   t -> fd_std_out = true;
-  bitmap_set(t -> fd_entry, 0, true); 
-  bitmap_set(t -> fd_entry, 1, true); 
-  bitmap_set(t -> fd_entry, 2, true); 
 #endif
 
   intr_set_level (old_level);
@@ -262,14 +362,18 @@ thread_create (const char *name, int priority,
 {
   //printf("inside thread cretae\n");
 	struct thread *t;
+  tid_t tid;
 	t = thread_create_blocked (name, priority, function, aux);
   
   if (t == NULL)
   	return TID_ERROR;
-	else
-  	/* Add to run queue. */
-  	thread_unblock (t);
-  return t->tid;
+
+  /* Add to run queue.  T may run, and even exit, before we
+     return if it outranks us. */
+  tid = t->tid;
+  thread_unblock (t);
+  thread_yield_to_higher ();
+  return tid;
 }
 
 /* Puts the current thread to sleep.  It will not be scheduled
@@ -305,7 +409,7 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  ready_push (t);
   t->status = THREAD_READY;
   intr_set_level (old_level);
 }
@@ -343,45 +447,50 @@ thread_tid (void)
   return thread_current ()->tid;
 }
 
+/* Returns the live thread with tid TID, or a null pointer if
+   there is none.  Must be called with interrupts off. */
 struct thread *
 get_thread (tid_t tid)
 {
-  ASSERT(intr_get_level() == INTR_OFF);
- //TODO: remove the interrut disable 
-  tid_t pid = tid;
+  struct list *bucket = &thread_buckets[(unsigned) tid % TID_HASH_BUCKETS];
   struct list_elem *e;
-  struct thread *t = NULL;
-  //int old_level = intr_disable();
-  for (e = list_begin(&all_list); e != list_tail(&all_list); e = list_next(e))
-  {
-    t = list_entry(e, struct thread, allelem);
-    if (t->tid == pid)
-      break;
-    else
-      t = NULL;
-  }
-  //intr_set_level(old_level);
-  return t;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  for (e = list_begin (bucket); e != list_end (bucket); e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, tidelem);
+      if (t->tid == tid)
+        return t;
+    }
+  return NULL;
 }
 
+/* Returns the exit record of the dead process with tid TID, or a
+   null pointer if there is none or it was already waited for.
+   Must be called with interrupts off. */
 struct exit_thread *
 get_exit_thread (tid_t tid)
 {
-  ASSERT(intr_get_level() == INTR_OFF);
-  tid_t pid = tid;
+  struct list *bucket = &exit_buckets[(unsigned) tid % TID_HASH_BUCKETS];
   struct list_elem *e;
-  struct exit_thread *t = NULL;
-  //int old_level = intr_disable();
-  for (e = list_begin(&dead_list); e != list_tail(&dead_list); e = list_next(e))
-  {
-    t = list_entry(e, struct exit_thread, elem);
-    if (t->tid == pid)
-      break;
-    else
-      t = NULL;
-  }
-  //intr_set_level(old_level);
-  return t;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  for (e = list_begin (bucket); e != list_end (bucket); e = list_next (e))
+    {
+      struct exit_thread *t = list_entry (e, struct exit_thread, tidelem);
+      if (t->tid == tid)
+        return t;
+    }
+  return NULL;
+}
+
+/* Makes T, which has just got its tid, visible to get_thread(). */
+static void
+thread_hash_insert (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  list_push_back (&thread_buckets[(unsigned) t->tid % TID_HASH_BUCKETS],
+                  &t->tidelem);
 }
 
 /* Deschedules the current thread and destroys it.  Never
@@ -399,59 +508,83 @@ thread_exit (int exit_code)
   dir_close(thread_current()->cwd);
  
   if (thread_current () -> current_executable)
-  {
   	file_close(thread_current()->current_executable);
-    fd_mem_free();
-    bitmap_destroy(thread_current() -> fd_entry);
-  }
+  fd_mem_free();
 //  lock_release(&file_lock);
-  /* Remove thread from all threads list, set our status to dying,
-     and schedule another process.  That process will destroy us
-     when it call schedule_tail(). */
+  if (thread_current() -> load_status)
+    printf("%s: exit(%d)\n", thread_current ()->name, exit_code);
+
+  /* Allocated up front to keep malloc() out of the stretch with
+     interrupts off below. */
+  struct exit_thread *exit = (struct exit_thread *) malloc (sizeof (struct exit_thread));
+  if (exit != NULL && get_thread (thread_current () -> parent) == NULL)
+  {
+    free (exit);
+    exit = NULL;
+  }
+
+  /* Free the exit records of our children, so that they do not
+     become zombies.  A child may still add one until interrupts
+     are off, so the list is emptied with interrupts off and each
+     record freed with them on.  Interrupts stay off once it is
+     empty. */
   intr_disable ();
+  while (!list_empty (&thread_current () -> exited_children))
+  {
+    struct exit_thread *child
+      = list_entry (list_pop_front (&thread_current () -> exited_children),
+                    struct exit_thread, elem);
+    list_remove (&child->tidelem);
+    intr_enable ();
+    free (child);
+    intr_disable ();
+  }
 
-  
+  /* Remove thread from all threads list, set our status to dying,
+     and schedule another process.  That process will destroy us
+     when it call schedule_tail().  Nothing below may block, or the
+     parent could exit and be freed before it is woken. */
+  uint64_t start = rdtsc ();
 
-  
-  if (thread_current() -> load_status)
-    printf("%s: exit(%d)\n", thread_current ()->name, exit_code);
- 
   /* do not create exit structure if current thread is orphan */
-  if(get_thread(thread_current() -> parent) != NULL)
+  struct thread *parent = get_thread (thread_current () -> parent);
+  if (parent != NULL && exit != NULL)
   {
-    struct exit_thread *exit = (struct exit_thread *) malloc (sizeof (struct exit_thread));
     exit->tid = thread_current ()->tid;
     exit->parent = thread_current ()->parent;
     exit->exit_code = exit_code;
     exit -> load_status = thread_current() -> load_status;
-    list_push_front (&dead_list, &exit->elem);
+    list_push_back (&parent -> exited_children, &exit->elem);
+    list_push_back (&exit_buckets[(unsigned) exit->tid % TID_HASH_BUCKETS],
+                    &exit->tidelem);
   }
-  /* prevent current thread's children from becoming zombie */
-  struct list_elem *e;
-  for (e = list_begin (&dead_list); e != list_end (&dead_list);
-       e = list_next (e))
-    {
-      struct exit_thread *t = list_entry (e, struct exit_thread, elem);
-      if (t->parent == thread_current() -> tid)
-      {
-        struct list_elem *next = list_remove (e);
-        thread_finish (t);
-        e = list_prev (next);
-      }
-    }
-  /* Wake up all the threads who have called wait on this thread. */
-  thread_wakeup();
+  else if (exit != NULL)
+  {
+    /* Our parent exited since we checked, which leaves this one
+       free() in the stretch. */
+    free (exit);
+  }
+  /* Wake up the parent if it is waiting for us. */
+  if (parent != NULL)
+    thread_wakeup (parent);
   list_remove (&thread_current()->allelem);
+  list_remove (&thread_current()->tidelem);
   thread_current ()->status = THREAD_DYING;
+  stack_high_water_max (thread_current (), &stack_high_water);
+  exit_cnt++;
+  exit_cycles += rdtsc () - start;
   schedule ();
   NOT_REACHED ();
 }
 
+/* Frees the exit record T once its parent has waited for it or
+   exited. */
 void
 thread_finish (struct exit_thread *t)
 {
   ASSERT(intr_get_level() == INTR_OFF);
   list_remove (&t->elem);
+  list_remove (&t->tidelem);
   free (t);
 }
 
@@ -473,24 +606,19 @@ thread_finish (struct exit_thread *t)
   palloc_free_page(t);
 }*/
 
-/* Wakes up all the threads sleeping on the current thread.
- * Should be called with interrupts off, preferrably from 
- * thread_exit() */
+/* Wakes up PARENT if it is sleeping in process_wait() on the
+   current thread.  Only a parent may wait for a thread, so there
+   is no one else to wake.  Should be called with interrupts off,
+   preferrably from thread_exit() */
 void
-thread_wakeup (void)
+thread_wakeup (struct thread *parent)
 {
   ASSERT(intr_get_level() == INTR_OFF);
 
-  struct list_elem *e;
-  struct thread *t;
-  for (e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e))
+  if (parent->wait_on == thread_tid())
   {
-    t = list_entry(e, struct thread, allelem);
-    if(t->wait_on == thread_tid())
-    {
-      t->wait_on = -1;
-      thread_unblock(t);
-    }
+    parent->wait_on = -1;
+    thread_unblock(parent);
   }
 }
 
@@ -506,12 +634,43 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
+    ready_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
 }
 
+/* Yields the CPU if a thread of higher priority than the running
+   thread is ready, for instance right after unblocking one.  In
+   an interrupt handler the yield happens on return from the
+   interrupt. */
+void
+thread_yield_to_higher (void)
+{
+  enum intr_level old_level = intr_disable ();
+  bool preempt = ready_max_priority () > thread_current ()->priority;
+
+  intr_set_level (old_level);
+  if (!preempt)
+    return;
+  if (intr_context ())
+    intr_yield_on_return ();
+  else
+    thread_yield ();
+}
+
+/* Returns true if the thread of list element A_ has a lower
+   priority than that of B_.  With list_max() this picks the
+   highest priority waiter, the earliest one among equals. */
+bool
+thread_priority_less (const struct list_elem *a_,
+                      const struct list_elem *b_, void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+  return a->priority < b->priority;
+}
+
 /* Invoke function 'func' on all threads, passing along 'aux'.
    This function must be called with interrupts off. */
 void
@@ -529,11 +688,79 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's priority to NEW_PRIORITY.  Ignored
+   under the MLFQS, which computes priorities itself. */
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  if (thread_mlfqs)
+    return;
+
+  thread_current ()->base_priority = new_priority;
+  thread_refresh_priority ();
+}
+
+/* Raises T's priority to PRIORITY on behalf of a thread waiting
+   for a lock T holds, moving T to its new ready queue if it is
+   ready.  Must be called with interrupts off. */
+void
+thread_donate_priority (struct thread *t, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (is_thread (t));
+
+  if (priority <= t->priority)
+    return;
+  if (t->status == THREAD_READY)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_push (t);
+    }
+  else
+    t->priority = priority;
+}
+
+/* Recomputes the running thread's priority from its base priority
+   and the highest priority waiter on each lock it still holds,
+   then yields if that dropped it below a ready thread.  Called
+   when a lock is released or the base priority changes.  There
+   is no donation under the MLFQS. */
+void
+thread_refresh_priority (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int priority = cur->base_priority;
+  struct list_elem *e;
+
+  if (thread_mlfqs)
+    {
+      thread_yield_to_higher ();
+      return;
+    }
+
+  old_level = intr_disable ();
+  for (e = list_begin (&cur->held_locks); e != list_end (&cur->held_locks);
+       e = list_next (e))
+    {
+      struct list *waiters = &list_entry (e, struct lock, elem)
+                                -> semaphore.waiters;
+      if (!list_empty (waiters))
+        {
+          struct thread *t = list_entry (list_max (waiters,
+                                                   thread_priority_less,
+                                                   NULL),
+                                         struct thread, elem);
+          if (t->priority > priority)
+            priority = t->priority;
+        }
+    }
+  cur->priority = priority;
+  intr_set_level (old_level);
+  thread_yield_to_higher ();
 }
 
 /* Returns the current thread's priority. */
@@ -543,35 +770,112 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE, clamped to
+   NICE_MIN...NICE_MAX, and recomputes its priority under the
+   MLFQS. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  if (nice < NICE_MIN)
+    nice = NICE_MIN;
+  else if (nice > NICE_MAX)
+    nice = NICE_MAX;
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority (cur, NULL);
+  intr_set_level (old_level);
+  thread_yield_to_higher ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load = fp_round (load_avg * 100);
+  intr_set_level (old_level);
+  return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent = fp_round (thread_current ()->recent_cpu * 100);
+  intr_set_level (old_level);
+  return recent;
+}
+
+/* Updates the MLFQS statistics at a timer tick in which CUR was
+   running.  Only CUR's recent_cpu changes between the once a
+   second updates, so only its priority needs recomputing every
+   TIME_SLICE ticks. */
+static void
+mlfqs_tick (struct thread *cur)
+{
+  int64_t now = timer_ticks ();
+
+  if (cur != idle_thread)
+    cur->recent_cpu = fp_add_int (cur->recent_cpu, 1);
+
+  if (now % TIMER_FREQ == 0)
+    {
+      int ready = ready_cnt + (cur != idle_thread);
+
+      /* load_avg = (59/60) * load_avg + (1/60) * ready. */
+      load_avg = (load_avg * 59 + fp_from_int (ready)) / 60;
+      thread_foreach (mlfqs_update_recent_cpu, NULL);
+      thread_foreach (mlfqs_update_priority, NULL);
+    }
+  else if (now % TIME_SLICE == 0)
+    mlfqs_update_priority (cur, NULL);
+}
+
+/* recent_cpu = (2 * load_avg) / (2 * load_avg + 1) * recent_cpu
+                + nice. */
+static void
+mlfqs_update_recent_cpu (struct thread *t, void *aux UNUSED)
+{
+  fixed_t decay = fp_div (load_avg * 2, fp_add_int (load_avg * 2, 1));
+  t->recent_cpu = fp_add_int (fp_mul (decay, t->recent_cpu), t->nice);
+}
+
+/* priority = PRI_MAX - recent_cpu / 4 - nice * 2, clamped to
+   PRI_MIN...PRI_MAX.  A ready thread moves to its new queue. */
+static void
+mlfqs_update_priority (struct thread *t, void *aux UNUSED)
+{
+  int priority = PRI_MAX - fp_trunc (t->recent_cpu / 4) - t->nice * 2;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  if (priority == t->priority || t == idle_thread)
+    return;
+  if (t->status == THREAD_READY)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_push (t);
+    }
+  else
+    t->priority = priority;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -588,6 +892,7 @@ idle (void *idle_started_ UNUSED)
 {
   struct semaphore *idle_started = idle_started_;
   idle_thread = thread_current ();
+  idle_thread->priority = PRI_MIN;
   sema_up (idle_started);
 
   for (;;) 
@@ -657,10 +962,16 @@ init_thread (struct thread *t, const char *name, int priority)
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
+  t->base_priority = priority;
+  list_init (&t->held_locks);
+  list_init (&t->exited_children);
   t->magic = THREAD_MAGIC;
   t->wait_on = -1;
   t -> load_status = false;
   t -> wait_on_exec = false;
+#ifdef USERPROG
+  lock_init (&t -> pagedir_lock);
+#endif
   list_push_back (&all_list, &t->allelem);
 }
 
@@ -674,6 +985,7 @@ alloc_frame (struct thread *t, size_t size)
   ASSERT (size % sizeof (uint32_t) == 0);
 
   t->stack -= size;
+  memset (t->stack, 0, size);
   return t->stack;
 }
 
@@ -685,10 +997,56 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  int priority = ready_max_priority ();
+  struct thread *t;
+
+  if (priority < 0)
     return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+  t = list_entry (list_pop_front (&ready_queues[priority]),
+                  struct thread, elem);
+  ready_cnt--;
+  if (list_empty (&ready_queues[priority]))
+    ready_mask[priority / 32] &= ~(1u << (priority % 32));
+  return t;
+}
+
+/* Appends T to the ready queue for its priority. */
+static void
+ready_push (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_cnt++;
+  ready_mask[t->priority / 32] |= 1u << (t->priority % 32);
+}
+
+/* Takes ready thread T off its ready queue. */
+static void
+ready_remove (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  list_remove (&t->elem);
+  ready_cnt--;
+  if (list_empty (&ready_queues[t->priority]))
+    ready_mask[t->priority / 32] &= ~(1u << (t->priority % 32));
+}
+
+/* Returns the highest priority of a ready thread, or -1 if no
+   thread is ready. */
+static int
+ready_max_priority (void)
+{
+  int w;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (w = READY_MASK_WORDS - 1; w >= 0; w--)
+    if (ready_mask[w] != 0)
+      return w * 32 + 31 - __builtin_clz (ready_mask[w]);
+  return -1;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -718,6 +1076,7 @@ schedule_tail (struct thread *prev)
 
   /* Start new time slice. */
   thread_ticks = 0;
+  intr_watch_resume ();
 
 #ifdef USERPROG
   /* Activate the new address space. */
@@ -755,7 +1114,10 @@ schedule (void)
   ASSERT (is_thread (next));
 
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      switch_cnt++;
+      prev = switch_threads (cur, next);
+    }
   schedule_tail (prev); 
 }
 
@@ -777,83 +1139,131 @@ allocate_tid (void)
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
 
-/* finds the next available fd for allocation */
-unsigned fd_next_available ()
+/* Most files a process may have open at once, including the
+   standard fds.  Set with the "-fdl" kernel command-line option. */
+int fd_limit = FD_LIMIT_DEFAULT;
+
+/* Slots in a new fd table.  It doubles as needed, up to fd_limit. */
+#define FD_TABLE_INITIAL 16
+
+/* Returns true if FD is in use by T, either by an open file or
+   by the console while the standard fd has not been closed. */
+static bool
+fd_used (struct thread *t, int fd)
 {
-  return bitmap_scan (thread_current() -> fd_entry, 0,
-              1, false);
+  if ((fd == 0 && t -> fd_std_in) || (fd == 1 && t -> fd_std_out)
+      || (fd == 2 && t -> fd_std_err))
+    return true;
+  return fd < t -> fd_cap && t -> fd_table[fd] != NULL;
+}
+
+/* Grows T's fd table to CAP slots, clearing the new ones.
+   Returns false if out of memory. */
+static bool
+fd_table_grow (struct thread *t, int cap)
+{
+  struct file **table = realloc (t -> fd_table, cap * sizeof *table);
+  if (table == NULL)
+    return false;
+  memset (table + t -> fd_cap, 0, (cap - t -> fd_cap) * sizeof *table);
+  t -> fd_table = table;
+  t -> fd_cap = cap;
+  return true;
+}
+
+/* Creates T's fd table on its first use.  Threads that never open
+   a file, such as kernel threads, never get one.  Returns false if
+   out of memory. */
+bool
+fd_table_create (struct thread *t)
+{
+  if (t -> fd_table != NULL)
+    return true;
+  t -> fd_cap = 0;
+  t -> fd_free = 0;
+  return fd_table_grow (t, FD_TABLE_INITIAL < fd_limit
+                           ? FD_TABLE_INITIAL : fd_limit);
 }
 
 /*
- * Add a file F to our file descriptor table,
- * and return corresponding fd
+ * Add a file F to our file descriptor table, at the lowest free
+ * fd, and return that fd.  Closes F and returns -1 if the process
+ * has fd_limit files open or memory runs out.
  */ 
 unsigned add_file( struct file *f)
 {
-   struct fd_table_element *fd_elem = (struct fd_table_element *)malloc(sizeof (struct fd_table_element));
-   fd_elem -> file_name = f;
-   fd_elem -> fd = fd_next_available();
-   bitmap_mark (thread_current() -> fd_entry, fd_elem -> fd);
-   list_push_back (thread_current() -> fd_table, &fd_elem -> file_elem);
-   return fd_elem -> fd;
+  struct thread *t = thread_current ();
+  int fd;
+
+  if (!fd_table_create (t))
+    goto fail;
+  for (fd = t -> fd_free; fd_used (t, fd); fd++)
+    continue;
+  if (fd >= t -> fd_cap)
+  {
+    int cap = t -> fd_cap * 2 < fd_limit ? t -> fd_cap * 2 : fd_limit;
+    if (fd >= cap || !fd_table_grow (t, cap))
+      goto fail;
+  }
+  t -> fd_table[fd] = f;
+  t -> fd_free = fd + 1;
+  return fd;
+
+ fail:
+  file_close (f);
+  return -1;
 }
 
 /*
  * Find a file with gived fd in current thread
  * Currently not handling console
  */
-struct fd_table_element * find_file (unsigned fd)
+struct file * find_file (unsigned fd)
 {
-  struct list_elem *iterator;
-  struct list *fd_table = thread_current ()->fd_table;
-  struct fd_table_element *result = NULL;
-  struct fd_table_element *temp;
-  for (iterator = list_begin (fd_table); iterator != list_end (fd_table); iterator = list_next (iterator))
-  {
-    temp = list_entry (iterator, struct fd_table_element, file_elem);
-    if (temp -> fd == fd)
-    {
-      result = temp;
-      break;
-    }
-  }
-  return result;
+  struct thread *t = thread_current ();
+  if (fd >= (unsigned) t -> fd_cap)
+    return NULL;
+  return t -> fd_table[fd];
 }
 
 /*
- * Remove the entry from the fd_entry
+ * Remove the entry from the fd table
  */
 void entry_remove (unsigned fd)
 {
+  struct thread *t = thread_current ();
+
   /* std_in was directed to conslole initially, if this fag is still set then
    * unset the flag and now fd 0 will behave normally
    */
-  if (fd == 0 && thread_current() -> fd_std_in)
-    thread_current() -> fd_std_in = false;
+  if (fd == 0 && t -> fd_std_in)
+    t -> fd_std_in = false;
 
   /* similarly */
-  if (fd == 1 && thread_current() -> fd_std_out)
-    thread_current() -> fd_std_out = false;
-  if (fd == 2 && thread_current() -> fd_std_err)
-    thread_current() -> fd_std_err = false;
-
-  bitmap_reset (thread_current() -> fd_entry, fd);
+  if (fd == 1 && t -> fd_std_out)
+    t -> fd_std_out = false;
+  if (fd == 2 && t -> fd_std_err)
+    t -> fd_std_err = false;
+
+  if (fd < (unsigned) t -> fd_cap)
+    t -> fd_table[fd] = NULL;
+  if (fd < (unsigned) t -> fd_free)
+    t -> fd_free = fd;
 }
 
-/* Call this function with interupts disable */
+/* Closes all the files of the current thread and frees its fd
+   table. */
 void fd_mem_free (void)
 {
-  struct list_elem *iterator;
-  struct list *fd_table = thread_current ()->fd_table;
-  struct fd_table_element *temp;
-  for (iterator = list_begin (fd_table); iterator != list_end (fd_table); )
-  {
-    temp = list_entry (iterator, struct fd_table_element, file_elem);
-    iterator = list_next (iterator);
-    file_close (temp -> file_name);
-    free (temp);
-  }
-  free (fd_table);
+  struct thread *t = thread_current ();
+  int fd;
+
+  for (fd = 0; fd < t -> fd_cap; fd++)
+    if (t -> fd_table[fd] != NULL)
+      file_close (t -> fd_table[fd]);
+  free (t -> fd_table);
+  t -> fd_table = NULL;
+  t -> fd_cap = 0;
 }
 
 void thread_filesys_init (void)
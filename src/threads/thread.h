@@ -5,6 +5,7 @@
 #include <debug.h>
 #include <list.h>
 #include <stdint.h>
+#include "threads/fixed-point.h"
 #include "threads/synch.h"
 #include "lib/kernel/hash.h"
 #include "filesys/file.h"
@@ -30,6 +31,12 @@ typedef int mapid_t;
 #define PRI_MIN 0                       /* Lowest priority. */
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
+#define DONATION_DEPTH_MAX 8            /* Locks a donation passes through. */
+
+/* Thread niceness, for the multi-level feedback queue scheduler. */
+#define NICE_MIN -20                    /* Least favorable to others. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Most favorable to others. */
 #define STACK_MAX_PAGES 2048            /* Maximum number of stack pages */
 /* Debugging mode*/
 // #define DEBUG
@@ -85,47 +92,74 @@ typedef int mapid_t;
    value, triggering the assertion. */
 /* The `elem' member has a dual purpose.  It can be an element in
    the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+   semaphore wait list (synch.c) or the sleep list (timer.c).  It
+   can be used these ways only because they are mutually
+   exclusive: only a thread in the ready state is on the run
+   queue, whereas only a thread in the blocked state is on a
+   semaphore wait list or the sleep list, and never both. */
 struct thread
   {
+    /* What the scheduler touches on every switch comes first, to
+       share a cache line. */
+
     /* Owned by thread.c. */
+    uint8_t *stack;                     /* Saved stack pointer. */
+    enum thread_status status;          /* Thread state. */
+    int priority;                       /* Priority, including donations. */
     tid_t tid;                          /* Thread identifier. */
+
+    /* Shared between thread.c and synch.c. */
+    struct list_elem elem;              /* List element. */
+
+    /* Owned by devices/timer.c. */
+    int64_t wakeup_tick;                /* Tick to wake up at in timer_sleep(). */
+
+    /* Owned by thread.c. */
+    int base_priority;                  /* Priority before donations. */
+    struct lock *waiting_lock;          /* Lock being waited for, if any. */
+    struct list held_locks;             /* Locks held, whose waiters donate. */
+    int nice;                           /* Niceness, for the MLFQS. */
+    fixed_t recent_cpu;                 /* Recent CPU use, for the MLFQS. */
     tid_t parent;                       /* Parent's identifier */
-    enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
-    uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
     struct list_elem allelem;           /* List element for all threads list. */
-    
-    /* Shared between thread.c and synch.c. */
-    struct list_elem elem;              /* List element. */
+    struct list_elem tidelem;           /* List element in a tid hash chain. */
+    struct list exited_children;        /* Exit records of children not yet waited for. */
     bool wait_on_exec;                  /* Is the thread waiting for execed child to load. */
     bool load_status;                  /* Whether the executable was successfully loaded. */
     tid_t wait_on;                      /* Thread to sleep on */
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory.*/
-    struct list * fd_table;             /* fd table list pointer*/
-    struct bitmap *fd_entry;            /* keep record of used fd*/
+    struct lock pagedir_lock;           /* Guards pagedir bits and rss counts against the clock */
+    struct file **fd_table;             /* Open files indexed by fd, NULL until the first open */
+    int fd_cap;                         /* Slots in fd_table */
+    int fd_free;                        /* No fd below this one is free */
     struct file * current_executable;   /* currently executing file*/
     struct hash * sup_pt;               /* Supplemental page table */
+    struct sup_page_table_entry ***sup_pt_index; /* Radix index over sup_pt */
     struct lock pt_lock;                /* lock for sup_page table */
     struct list * mapping;              /* List of mmaped files */
+    struct list * regions;              /* Regions of the address space */
 
     bool fd_std_in;                     /* boolean to keep */
     bool fd_std_out;                    /* track of console*/
     bool fd_std_err;                    /* IO */
     void *user_stack_bottom;            /* user stack */
     void *esp;                           /* esp of this thread */
+    void *fault_around_next;            /* Page right after the last fault-around window */
+    int fault_around_window;            /* Current fault-around window, in pages */
+    void *fault_victim;                 /* Page evicted while serving the current fault */
+    int rss;                            /* Resident user pages */
+    int rss_limit;                      /* Resident pages before reclaiming own pages, 0 if none */
+    int ws_hits;                        /* Pages found accessed in sweep ws_sweep */
+    int ws_size;                        /* Pages found accessed in the sweep before */
+    unsigned ws_sweep;                  /* Clock sweep ws_hits was counted in */
 #endif
     int exit_code;                      /* Exit code. */
-    uint32_t pages[383];
-    /* Owned by thread.c. */
-    
     struct dir *cwd;                    /* current working directory */
+
+    /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
   };
   
@@ -134,17 +168,11 @@ struct exit_thread
   tid_t tid;
   tid_t parent;
   bool load_status;        /* Whether the executable was successfully laoded. */
-  struct list_elem elem;    /* List element for dead processes list */
+  struct list_elem elem;    /* List element in parent's exited_children */
+  struct list_elem tidelem; /* List element in a tid hash chain */
   int exit_code;            /* Exit code set by on thread exit */
 };
 
-struct fd_table_element
-{
-  struct file *file_name;
-  unsigned fd;
-  struct list_elem file_elem;            /* hanger of list */
-};
-
 struct sup_page_table_entry
 {
   void *vaddr;                          /* virtual address */
@@ -156,6 +184,10 @@ struct sup_page_table_entry
   uint32_t page_read_bytes;             /* page_read_byes of the mmaped file */
   bool writable;
   bool shared;                          /* Whether to have a private copy or a shared copy. */
+  bool zero_mapped;                     /* Mapped read-only to the shared zero frame. */
+  bool cow;                             /* Shared read-only until the first store. */
+  struct region *region;                /* Region the page belongs to, if any. */
+  struct list_elem region_elem;         /* Element in the region's page list. */
 };
 
 struct mapped_entry
@@ -167,10 +199,11 @@ struct mapped_entry
 };
 
 /* Functions to modify fd_table */
+#define FD_LIMIT_DEFAULT 500            /* Default for fd_limit. */
+extern int fd_limit;
+bool fd_table_create (struct thread *);
 unsigned add_file (struct file *);
-struct fd_table_element * find_file (unsigned);
-void remove_file (struct file *);
-unsigned fd_next_available (void);
+struct file * find_file (unsigned);
 void entry_remove(unsigned fd);
 
 /* Functions for filesys */
@@ -185,6 +218,9 @@ void thread_start (void);
 
 void thread_tick (void);
 void thread_print_stats (void);
+size_t thread_stack_high_water (struct thread *);
+long long thread_idle_ticks (void);
+long long thread_switch_cnt (void);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
@@ -201,6 +237,9 @@ void thread_exit (int) NO_RETURN;
 void thread_finish (struct exit_thread *);
 //void thread_cleanup (struct thread *t);
 void thread_yield (void);
+void thread_yield_to_higher (void);
+bool thread_priority_less (const struct list_elem *,
+                           const struct list_elem *, void *aux);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
@@ -208,6 +247,8 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_donate_priority (struct thread *, int);
+void thread_refresh_priority (void);
 
 struct thread *get_thread (tid_t);
 struct exit_thread *get_exit_thread (tid_t);
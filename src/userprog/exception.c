@@ -9,6 +9,7 @@
 #include "vm/vm.h"
 #include "threads/palloc.h"
 #include "vm/frame.h"
+#include "vm/region.h"
 #include "threads/pte.h"
 #include "lib/string.h"
 /* Number of page faults processed. */
@@ -139,7 +140,7 @@ static void
 page_fault (struct intr_frame *f) 
 {
   bool not_present;  /* True: not-present page, false: writing r/o page. */
-  bool write UNUSED;        /* True: access was write, false: access was read. */
+  bool write;               /* True: access was write, false: access was read. */
   bool user UNUSED;         /* True: access by user, false: access by kernel. */
   void *fault_addr;  /* Fault address. */
 
@@ -175,20 +176,42 @@ page_fault (struct intr_frame *f)
    * then we can simple assert that we want the thread to die.
    * This behavior is currently not handled.
    */
+  struct thread *t;
+  struct sup_page_table_entry *sup_pt_entry;
+
+  /*
+   * A store to a page mapped to the shared zero frame or to a shared
+   * copy-on-write frame is the only protection fault we expect, it
+   * gives the page a frame of its own. This may come from the kernel
+   * too, writing to a user buffer.
+   */
+  if (fault_addr != NULL && !not_present && write && is_user_vaddr (fault_addr))
+  {
+    sup_pt_entry = find_page_by_vaddr (pg_round_down (fault_addr));
+    if (sup_pt_entry != NULL && ((sup_pt_entry -> zero_mapped
+        && sup_pt_entry -> writable) || sup_pt_entry -> cow))
+    {
+      if (!sup_page_table_load (sup_pt_entry, true))
+        thread_exit (-1);
+      return;
+    }
+  }
+
   if (fault_addr == NULL || !not_present || !is_user_vaddr (fault_addr))
   {
     thread_exit (-1);
   }
 
-  struct thread *t;
-  struct sup_page_table_entry *sup_pt_entry;
-
   t = thread_current ();
   
   /* We are proceeding only if the fault_address is not present */
   ASSERT (not_present);
 
-  sup_pt_entry = find_page_by_vaddr (pg_round_down (fault_addr));
+  /* The first touch of a large zero filled block may map all of it. */
+  if (region_map_superpage (fault_addr))
+    return;
+
+  sup_pt_entry = vm_page_get (pg_round_down (fault_addr));
 
   switch (f -> cs)
   {
@@ -210,13 +233,15 @@ page_fault (struct intr_frame *f)
         {
           if (sup_pt_entry)
           {
-            bool success = sup_page_table_load (sup_pt_entry);
+            bool success = sup_page_table_load (sup_pt_entry, write);
             if (!success)
               thread_exit(-1);
             else
               return;
           }
-          vm_create_page_and_alloc (pg_round_down(fault_addr));
+          sup_pt_entry = vm_page_create (pg_round_down (fault_addr));
+          if (sup_pt_entry == NULL || !sup_page_table_load (sup_pt_entry, write))
+            thread_exit (-1);
           return;
         }
         
@@ -226,7 +251,7 @@ page_fault (struct intr_frame *f)
          */
         else if (sup_pt_entry != NULL)
         {
-            bool success = sup_page_table_load (sup_pt_entry); 
+            bool success = sup_page_table_load (sup_pt_entry, write); 
             if (!success)
               thread_exit(-1);
             else
@@ -259,7 +284,7 @@ page_fault (struct intr_frame *f)
     if (is_user_vaddr(t -> esp) && is_user_vaddr(fault_addr))
     {
       //~ printf (" page fault fault_address %x, thread %d \n", fault_addr, t ->tid);
-      sup_pt_entry = find_page_by_vaddr (pg_round_down(fault_addr));
+      sup_pt_entry = vm_page_get (pg_round_down(fault_addr));
       /*
        * Handling Stack growth with the esp of user and not the esp from the
        * trap frame.
@@ -270,13 +295,15 @@ page_fault (struct intr_frame *f)
         // printf ("loda \n");
         if (sup_pt_entry)
         {
-          bool success = sup_page_table_load (sup_pt_entry);
+          bool success = sup_page_table_load (sup_pt_entry, write);
           if (!success)
             thread_exit(-1);
           else
             return;
         }
-        vm_create_page_and_alloc (pg_round_down(fault_addr));
+        sup_pt_entry = vm_page_create (pg_round_down (fault_addr));
+        if (sup_pt_entry == NULL || !sup_page_table_load (sup_pt_entry, write))
+          thread_exit (-1);
         return;
       }
       /*
@@ -284,7 +311,7 @@ page_fault (struct intr_frame *f)
        */
       if (sup_pt_entry != NULL)
       {
-        bool success = sup_page_table_load (sup_pt_entry);
+        bool success = sup_page_table_load (sup_pt_entry, write);
         if (!success)
           thread_exit(-1);
         else
@@ -34,8 +34,10 @@ pagedir_destroy (uint32_t *pd)
     return;
 
   ASSERT (pd != base_page_dir);
+  /* Superpages belong to the regions that mapped them and must
+     have been unmapped already. */
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
-    if (*pde & PTE_P) 
+    if ((*pde & PTE_P) && !(*pde & PTE_PS)) 
       {
         uint32_t *pt = pde_get_pt (*pde);
         uint32_t *pte;
@@ -53,7 +55,9 @@ pagedir_destroy (uint32_t *pd)
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.  If VADDR lies in a superpage, its PDE is
+   returned, which has the accessed and dirty bits in the same
+   places as a PTE. */
 static uint32_t *
 lookup_page (uint32_t *pd, const void *vaddr, bool create)
 {
@@ -81,6 +85,9 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
         return NULL;
     }
 
+  if (*pde & PTE_PS)
+    return pde;
+
   /* Return the page table entry. */
   pt = pde_get_pt (*pde);
   return &pt[pt_no (vaddr)];
@@ -119,6 +126,44 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
     return false;
 }
 
+/* Maps the superpage at kernel virtual address KPAGE at user
+   virtual address UPAGE in PD, both 4 MB aligned.  Fails if the
+   page size extension is off or if UPAGE's page directory entry
+   is in use, even by an empty page table. */
+bool
+pagedir_set_superpage (uint32_t *pd, void *upage, void *kpage, bool writable)
+{
+  uint32_t *pde = pd + pd_no (upage);
+
+  ASSERT ((uintptr_t) upage % SUPERPAGE_SIZE == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (pd != base_page_dir);
+
+  if (!paging_pse || *pde != 0)
+    return false;
+  *pde = pde_create_super_user (kpage, writable);
+  return true;
+}
+
+/* Removes the superpage mapped at user virtual address UPAGE from
+   PD and returns its kernel virtual address, or a null pointer if
+   there is none.  The superpage itself is not freed. */
+void *
+pagedir_clear_superpage (uint32_t *pd, void *upage)
+{
+  uint32_t *pde = pd + pd_no (upage);
+  void *kpage;
+
+  ASSERT (is_user_vaddr (upage));
+
+  if (!(*pde & PTE_PS))
+    return NULL;
+  kpage = pde_get_super (*pde);
+  *pde = 0;
+  invalidate_pagedir (pd);
+  return kpage;
+}
+
 /* Looks up the physical address that corresponds to user virtual
    address UADDR in PD.  Returns the kernel virtual address
    corresponding to that physical address, or a null pointer if
@@ -131,7 +176,10 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
   ASSERT (is_user_vaddr (uaddr));
   
   pte = lookup_page (pd, uaddr, false);
-  if (pte != NULL && (*pte & PTE_P) != 0)
+  if (pte != NULL && (*pte & PTE_PS) != 0)
+    return (uint8_t *) pde_get_super (*pte)
+           + ((uintptr_t) uaddr & (SUPERPAGE_SIZE - 1));
+  else if (pte != NULL && (*pte & PTE_P) != 0)
     return pte_get_page (*pte) + pg_ofs (uaddr);
   else
     return NULL;
@@ -157,6 +205,25 @@ pagedir_clear_page (uint32_t *pd, void *upage)
     }
 }
 
+/* Sets the writable bit to WRITABLE in the PTE for user virtual
+   page UPAGE in PD.  Other bits are preserved, and UPAGE need not
+   be present. */
+void
+pagedir_set_writable (uint32_t *pd, const void *upage, bool writable)
+{
+  uint32_t *pte = lookup_page (pd, upage, false);
+  if (pte != NULL)
+    {
+      if (writable)
+        *pte |= PTE_W;
+      else
+        {
+          *pte &= ~(uint32_t) PTE_W;
+          invalidate_pagedir (pd);
+        }
+    }
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
    that is, if the page has been modified since the PTE was
    installed.
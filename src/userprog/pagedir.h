@@ -9,7 +9,10 @@ uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
 void *pagedir_get_page (uint32_t *pd, const void *upage);
+bool pagedir_set_superpage (uint32_t *pd, void *upage, void *kpage, bool rw);
+void *pagedir_clear_superpage (uint32_t *pd, void *upage);
 void pagedir_clear_page (uint32_t *pd, void *upage);
+void pagedir_set_writable (uint32_t *pd, const void *upage, bool writable);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
@@ -12,18 +12,68 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "vm/vm.h"
 #include "vm/frame.h"
+#include "vm/region.h"
+#include "lib/kernel/bitmap.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
+
+/* What a forked child is started with. */
+struct fork_info
+  {
+    struct thread *parent;              /* Blocked until the copy is done. */
+    struct intr_frame if_;              /* Parent's registers at fork(). */
+  };
+
+/* Number of executables whose layout is cached. */
+#define EXEC_CACHE_SIZE 8
+/* Most loadable segments an executable can have to be cached. */
+#define EXEC_MAX_SEGMENTS 8
+
+/* A loadable segment, as passed to load_segment(). */
+struct exec_segment
+  {
+    uint32_t file_page;                 /* File offset of the first page. */
+    uint32_t mem_page;                  /* Address of the first page. */
+    uint32_t read_bytes;                /* Bytes read from the file. */
+    uint32_t zero_bytes;                /* Bytes zeroed after them. */
+    bool writable;
+  };
+
+/* Parsed and validated layout of an executable. Executing the same
+   program again builds its regions from here without reading the
+   headers. */
+struct exec_image
+  {
+    block_sector_t sector;              /* Inode sector, 0 if unused. */
+    unsigned write_cnt;                 /* inode_write_cnt() when parsed. */
+    unsigned last_use;                  /* Exec count at the last hit. */
+    void (*entry) (void);               /* Entry point. */
+    int segment_cnt;
+    struct exec_segment segments[EXEC_MAX_SEGMENTS];
+  };
+
+static struct exec_image exec_cache[EXEC_CACHE_SIZE];
+static struct lock exec_cache_lock;
+static unsigned exec_cnt;
+
+static bool exec_cache_lookup (struct file *, struct exec_image *);
+static void exec_cache_insert (struct file *, const struct exec_image *);
 // static thread_func start_exec_process NO_RETURN;
 static bool load (struct thread *t, const char *cmdline, void (**eip) (void), void **esp);
+static bool fork_address_space (struct thread *parent);
+static bool fork_files (struct thread *parent);
+static int process_wait_load (tid_t tid);
 char **create_args(char *file_name);
 void load_args(char **argv, char **load_addr);
 
@@ -92,6 +142,13 @@ void load_args(char **argv, char **load_addr) {
    FILENAME.  The new thread may be scheduled (and may even exit)
    before process_execute() returns.  Returns the new process's
    thread id, or TID_ERROR if the thread cannot be created. */
+/* Initializes the cache of executable layouts. */
+void
+process_init (void)
+{
+  lock_init (&exec_cache_lock);
+}
+
 tid_t
 process_execute (const char *file_name) 
 {
@@ -172,11 +229,50 @@ process_exec (const char* file_name) {
   int result = -1;
   int old_level = intr_disable();
   tid_t tid = process_execute (file_name);
+  if (tid != TID_ERROR)
+    result = process_wait_load (tid);
+  intr_set_level (old_level);
+  return result;
+}
+
+/* Creates a copy of the current process, which made the system call
+   whose registers are in F. The copy shares the private pages until
+   either process stores to them. Returns the child's tid, or -1 if it
+   could not be set up. */
+tid_t
+process_fork (const struct intr_frame *f)
+{
+  struct thread *cur = thread_current ();
+  struct fork_info *info = malloc (sizeof *info);
+  int result = -1;
+  if (info == NULL)
+    return -1;
+  info -> parent = cur;
+  info -> if_ = *f;
+
+  /* The child copies from us while we are blocked, keeping our
+     address space still.  It runs at our own priority, not one
+     donated to us; thread_create() copies nice and recent_cpu. */
+  int old_level = intr_disable ();
+  tid_t tid = thread_create (cur -> name, cur -> base_priority, start_fork,
+                             info);
   if (tid == TID_ERROR)
-  {
-    result = -1;
-    goto done;
-  }
+    free (info);
+  else
+    result = process_wait_load (tid);
+  intr_set_level (old_level);
+  return result;
+}
+
+/* Blocks until child TID, just created by exec or fork, is set up.
+   Returns TID, or -1 if it failed. Should be called with interrupts
+   off since thread_create(), so that the child can not wake us up
+   before we block. */
+static int
+process_wait_load (tid_t tid)
+{
+  int result = -1;
+  ASSERT (intr_get_level () == INTR_OFF);
   thread_current() -> wait_on_exec = true;
 
   thread_block();
@@ -192,11 +288,98 @@ process_exec (const char* file_name) {
     ASSERT (exit_thread != NULL);
     result = exit_thread -> load_status ? tid : -1;
   }
-done:
-  intr_set_level (old_level);
   return result;
 }
 
+/* A thread function that copies the process which forked it and
+   returns to user mode where it made the system call, with 0 as the
+   result. */
+static void
+start_fork (void *info_)
+{
+  struct fork_info *info = info_;
+  struct thread *cur = thread_current ();
+  struct intr_frame if_ = info -> if_;
+  bool success;
+
+  /* Faults on user pages while copying are handled as if they came
+     from a system call. */
+  cur -> esp = if_.esp;
+  cur -> rss_limit = info -> parent -> rss_limit;
+  success = fork_address_space (info -> parent) && fork_files (info -> parent);
+  free (info);
+  cur -> load_status = success;
+
+  int old_level = intr_disable ();
+  struct thread *parent = get_thread (cur -> parent);
+  if (parent != NULL && parent -> wait_on_exec)
+    thread_unblock (parent);
+  intr_set_level (old_level);
+
+  if (!success)
+    thread_exit (-1);
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Sets up the current thread's address space as a copy of PARENT's,
+   see region_fork(), vm_mmap_fork() and sup_page_table_fork(). */
+static bool
+fork_address_space (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  t -> pagedir = pagedir_create ();
+  sup_pt_init ();
+  init_mmap ();
+  region_init ();
+  if (t -> pagedir == NULL)
+    return false;
+  process_activate ();
+
+  /* A handle of our own, closed when we exit. */
+  t -> current_executable = file_reopen (parent -> current_executable);
+  if (t -> current_executable == NULL)
+    return false;
+  file_deny_write (t -> current_executable);
+
+  return region_fork (parent, t -> current_executable)
+         && vm_mmap_fork (parent)
+         && sup_page_table_fork (parent);
+}
+
+/* Copies the file descriptors of PARENT to the current thread. Each
+   copy is a handle of its own on the file, at the same position. */
+static bool
+fork_files (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  int fd;
+
+  t -> fd_std_in = parent -> fd_std_in;
+  t -> fd_std_out = parent -> fd_std_out;
+  t -> fd_std_err = parent -> fd_std_err;
+  if (parent -> fd_table == NULL)
+    return true;
+  /* Same size as the parent's table, so the files keep their fds. */
+  t -> fd_table = calloc (parent -> fd_cap, sizeof *t -> fd_table);
+  if (t -> fd_table == NULL)
+    return false;
+  t -> fd_cap = parent -> fd_cap;
+  t -> fd_free = parent -> fd_free;
+  for (fd = 0; fd < parent -> fd_cap; fd++)
+  {
+    struct file *from = parent -> fd_table[fd];
+    if (from == NULL)
+      continue;
+    t -> fd_table[fd] = file_reopen (from);
+    if (t -> fd_table[fd] == NULL)
+      return false;
+    file_seek (t -> fd_table[fd], file_tell (from));
+  }
+  return true;
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -261,6 +444,7 @@ process_exit (void)
     sup_page_table_destroy (sup_pt);
   }
   cur -> sup_pt = NULL;
+  region_destroy ();
 
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
@@ -278,7 +462,9 @@ process_exit (void)
          directory before destroying the process's page
          directory, or our active page directory will be one
          that's been freed (and cleared). */
+      lock_acquire (&cur->pagedir_lock);
       cur->pagedir = NULL;
+      lock_release (&cur->pagedir_lock);
       pagedir_activate (NULL);
       pagedir_destroy (pd);
 
@@ -366,6 +552,7 @@ struct Elf32_Phdr
 
 static bool setup_stack (struct thread *t, void **esp);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
+static bool load_image (struct file *, struct exec_image *);
 static bool load_segment (struct thread *t, struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
                           bool writable);
@@ -381,9 +568,8 @@ load (struct thread *t, const char *file_name, void (**eip) (void), void **esp)
   ASSERT(t != NULL);
   ASSERT(t->pagedir == NULL)
   
-  struct Elf32_Ehdr ehdr;
   struct file *file = NULL;
-  off_t file_ofs;
+  struct exec_image image;
   bool success = false;
   int i;
 
@@ -394,6 +580,7 @@ load (struct thread *t, const char *file_name, void (**eip) (void), void **esp)
 
   /* Initialize the mmap list of this thread */
   init_mmap ();
+  region_init ();
   if (t->pagedir == NULL) 
     goto done;
   process_activate();
@@ -409,31 +596,81 @@ load (struct thread *t, const char *file_name, void (**eip) (void), void **esp)
   file_deny_write (t -> current_executable);
 
 
+  /* Use the layout parsed by an earlier exec, if the file did not
+     change since. */
+  if (!exec_cache_lookup (file, &image))
+    {
+      if (!load_image (file, &image))
+        goto done;
+      exec_cache_insert (file, &image);
+    }
+
+  for (i = 0; i < image.segment_cnt; i++)
+    {
+      struct exec_segment *seg = &image.segments[i];
+      if (!load_segment (t, file, seg -> file_page, (void *) seg -> mem_page,
+                         seg -> read_bytes, seg -> zero_bytes, seg -> writable))
+        goto done;
+    }
+
+  /* Set up stack. */
+  if (!setup_stack (t, esp))
+    goto done;
+
+  /* Start address. */
+  *eip = image.entry;
+
+  success = true;
+
+ done:
+  /* We arrive here whether the load is successful or not. */
+  //  file_close (file);
+  return success;
+}
+
+/* Reads and verifies the headers of executable FILE, recording its
+   entry point and loadable segments in IMAGE. Returns false if FILE
+   is not a valid executable or has more than EXEC_MAX_SEGMENTS
+   loadable segments. */
+static bool
+load_image (struct file *file, struct exec_image *image)
+{
+  struct Elf32_Ehdr ehdr;
+  struct Elf32_Phdr *phdrs;
+  off_t phdrs_size;
+  bool success = false;
+  int i;
+
+  /* Taken before reading anything, so that a write racing with us
+     makes the cached layout stale right away. */
+  image -> write_cnt = inode_write_cnt (file_get_inode (file));
+
   /* Read and verify executable header. */
-  if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
+  if (file_read_at (file, &ehdr, sizeof ehdr, 0) != sizeof ehdr
       || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
       || ehdr.e_type != 2
       || ehdr.e_machine != 3
       || ehdr.e_version != 1
       || ehdr.e_phentsize != sizeof (struct Elf32_Phdr)
       || ehdr.e_phnum > 1024) 
-    {
-      goto done; 
-    }
+    return false;
 
-  /* Read program headers. */
-  file_ofs = ehdr.e_phoff;
+  /* Read program headers, all at once. */
+  phdrs_size = ehdr.e_phnum * sizeof *phdrs;
+  if (ehdr.e_phoff > (Elf32_Off) file_length (file))
+    return false;
+  phdrs = malloc (phdrs_size);
+  if (phdrs == NULL && phdrs_size != 0)
+    return false;
+  if (file_read_at (file, phdrs, phdrs_size, ehdr.e_phoff) != phdrs_size)
+    goto done;
+
+  image -> entry = (void (*) (void)) ehdr.e_entry;
+  image -> segment_cnt = 0;
   for (i = 0; i < ehdr.e_phnum; i++) 
     {
-      struct Elf32_Phdr phdr;
-
-      if (file_ofs < 0 || file_ofs > file_length (file))
-        goto done;
-      file_seek (file, file_ofs);
+      struct Elf32_Phdr phdr = phdrs[i];
 
-      if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-        goto done;
-      file_ofs += sizeof phdr;
       switch (phdr.p_type) 
         {
         case PT_NULL:
@@ -470,31 +707,97 @@ load (struct thread *t, const char *file_name, void (**eip) (void), void **esp)
                   read_bytes = 0;
                   zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
                 }
-              if (!load_segment (t, file, file_page, (void *) mem_page,
-                                 read_bytes, zero_bytes, writable))
+              if (image -> segment_cnt == EXEC_MAX_SEGMENTS)
                 goto done;
+              struct exec_segment *seg = &image -> segments[image -> segment_cnt++];
+              seg -> file_page = file_page;
+              seg -> mem_page = mem_page;
+              seg -> read_bytes = read_bytes;
+              seg -> zero_bytes = zero_bytes;
+              seg -> writable = writable;
             }
           else
             goto done;
           break;
         }
     }
-
-  /* Set up stack. */
-  if (!setup_stack (t, esp))
-    goto done;
-
-  /* Start address. */
-  *eip = (void (*) (void)) ehdr.e_entry;
-
   success = true;
 
  done:
-  /* We arrive here whether the load is successful or not. */
-  //  file_close (file);
+  free (phdrs);
   return success;
 }
-
+
+/* Looks FILE up in the exec cache, copying its layout to IMAGE.
+   Returns false if it is not cached or was written to since. */
+static bool
+exec_cache_lookup (struct file *file, struct exec_image *image)
+{
+  struct inode *inode = file_get_inode (file);
+  block_sector_t sector = inode_get_inumber (inode);
+  bool found = false;
+  int i;
+  lock_acquire (&exec_cache_lock);
+  exec_cnt++;
+  for (i = 0; i < EXEC_CACHE_SIZE; i++)
+    if (exec_cache[i].sector == sector)
+      {
+        if (exec_cache[i].write_cnt == inode_write_cnt (inode))
+          {
+            exec_cache[i].last_use = exec_cnt;
+            *image = exec_cache[i];
+            found = true;
+          }
+        break;
+      }
+  lock_release (&exec_cache_lock);
+  return found;
+}
+
+/* Records IMAGE, the layout just parsed from FILE, in the exec
+   cache, replacing a stale entry for the same file or the least
+   recently used one. The entry names FILE's inode by sector only;
+   process_exec_cache_forget() drops it before that write count can
+   be lost or the sector reused. */
+static void
+exec_cache_insert (struct file *file, const struct exec_image *image)
+{
+  block_sector_t sector = inode_get_inumber (file_get_inode (file));
+  struct exec_image *victim = NULL;
+  int i;
+  lock_acquire (&exec_cache_lock);
+  for (i = 0; i < EXEC_CACHE_SIZE; i++)
+    {
+      struct exec_image *e = &exec_cache[i];
+      if (e -> sector == sector || e -> sector == 0)
+        {
+          victim = e;
+          break;
+        }
+      if (victim == NULL || e -> last_use < victim -> last_use)
+        victim = e;
+    }
+  *victim = *image;
+  victim -> sector = sector;
+  victim -> last_use = exec_cnt;
+  lock_release (&exec_cache_lock);
+}
+
+/* Drops the cached layout of the executable whose inode is at
+   SECTOR. Called by inode_close() when an inode that was written
+   to or removed goes out of memory: its write count starts over
+   at the next open, and a removed inode's sector may be reused. */
+void
+process_exec_cache_forget (block_sector_t sector)
+{
+  int i;
+  lock_acquire (&exec_cache_lock);
+  for (i = 0; i < EXEC_CACHE_SIZE; i++)
+    if (exec_cache[i].sector == sector)
+      exec_cache[i].sector = 0;
+  lock_release (&exec_cache_lock);
+}
+
 /* load() helpers. */
 
 // static bool install_page (struct thread *t, void *upage, void *kpage, bool writable);
@@ -569,35 +872,10 @@ load_segment (struct thread *t UNUSED, struct file *file, off_t ofs, uint8_t *up
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  struct sup_page_table_entry * pte = NULL;
-  file_seek (file, ofs);
-  int i=0;
-  while (read_bytes > 0 || zero_bytes > 0) 
-    {
-      /* Calculate how to fill this page.
-         We will read PAGE_READ_BYTES bytes from FILE
-         and zero the final PAGE_ZERO_BYTES bytes. */
-      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-      size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-      /* Get a page of memory. */
-      pte = vm_page_create (upage);
-      pte -> file = file;
-      pte -> offset = ofs;
-      pte -> page_read_bytes = page_read_bytes;
-      pte -> writable = writable;
-      pte -> file_mapped = false;
-      pte -> shared = false;// !writable;
-      pte -> frame = 0;
-      ofs += page_read_bytes;
-
-      /* Advance. */
-      read_bytes -= page_read_bytes;
-      zero_bytes -= page_zero_bytes;
-      upage += PGSIZE;
-      i++;
-    }
-  return true;
+  /* The pages are set up lazily, on the first fault, from the
+     region. */
+  return region_create (upage, (read_bytes + zero_bytes) / PGSIZE, file, ofs,
+                        read_bytes, writable, false) != NULL;
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -3,10 +3,15 @@
 #define USERPROG_PROCESS_H
 
 #include "threads/thread.h"
+#include "threads/interrupt.h"
+#include "devices/block.h"
 
+void process_init (void);
 tid_t process_execute (const char *file_name);
 tid_t process_exec (const char* file_name);
+tid_t process_fork (const struct intr_frame *);
 int process_wait (tid_t child_tid);
 void process_exit (void);
 void process_activate (void);
+void process_exec_cache_forget (block_sector_t sector);
 #endif /* userprog/process.h */
@@ -22,9 +22,14 @@
 #include "lib/string.h"
 #include "devices/input.h"
 #include "vm/vm.h"
+#include "vm/clock.h"
+#include "vm/trace.h"
 
 
 
+/* Most bytes of a user buffer read() and write() pin at once. */
+#define PIN_MAX_BYTES (16 * PGSIZE)
+
 static void syscall_handler (struct intr_frame *);
 static int getb_user (const uint32_t *uaddr, bool *is_valid);
 static int getl_user (const uint32_t *uaddr, bool *is_valid) UNUSED;
@@ -124,90 +129,50 @@ int write (int fd, const void *buffer, unsigned length)
 {
   int result;
   int ret = 0;
- // lock_acquire(&file_lock);
-  //~ printf ("yaha hu main \n");
+  unsigned done, cur_write;
   if (fd < 0 || (fd == STDIN_FILENO && thread_current() -> fd_std_in) 
       || (fd == 2 && thread_current() -> fd_std_err))
   {
     return -1;
   }
-  bool valid = validate_buffer (buffer, NULL, length, false);
-  if (!valid)
-  {
-  //  lock_release(&file_lock);
-    //~ printf ("kaha hu main \n");
-    on_pgfault ();
-    NOT_REACHED ();
-  }
 
-  int num_of_pages = length / PGSIZE;
-  int to_write = length;
-  int cur_write = 0;
-  int i = 0;
-  //~ printf ("no: %d, to_write %d", num_of_pages, to_write);
-  void *kpage = palloc_get_page (PAL_ASSERT);
-  for (i = 0; i <= num_of_pages; i++)
+  /* The buffer is written from in place, a chunk at a time pinned. */
+  for (done = 0; done < length; done += cur_write)
   {
-    if (to_write / PGSIZE == 0)
-      to_write = to_write % PGSIZE;
-
-    if (to_write == 0)
+    const char *ubuf = (const char *) buffer + done;
+    cur_write = length - done < PIN_MAX_BYTES ? length - done : PIN_MAX_BYTES;
+    if (!vm_pin (ubuf, cur_write, false))
     {
-      //~ printf ("exiting %d \n", i);
-      break;
+      on_pgfault ();
+      NOT_REACHED ();
     }
-
-    cur_write = (to_write > PGSIZE) ? PGSIZE : to_write;
-
-    memcpy (kpage, buffer + (length - to_write), cur_write);
     if (fd == STDOUT_FILENO && thread_current() -> fd_std_out)
     {
-      int limit = 256;
-      int i = cur_write / limit;
-      while (i > 0)
-      {
-        putbuf (kpage, limit);
-        kpage += limit;
-        i--;
-      }
-      putbuf (kpage, cur_write % limit);
+      unsigned ofs;
+      for (ofs = 0; ofs < cur_write; ofs += 256)
+        putbuf (ubuf + ofs, cur_write - ofs < 256 ? cur_write - ofs : 256);
       result = cur_write;
-    //~ printf (" WRITTEN console: %d", result);
     }
     else
     {
-      if (fd < 0)
-      {
-        palloc_free_page (kpage);
-        return 0;
-      }
-      
-      struct fd_table_element * fd_elem = find_file (fd);
-      if (fd_elem == NULL)
+      struct file *write = find_file (fd);
+      if (write == NULL)
       {
-        palloc_free_page (kpage);
+        vm_unpin (ubuf, cur_write);
         return 0;
       }
-      struct file *write = fd_elem -> file_name;
-      if(write == NULL)
+      if (inode_isDir (file_get_inode (write)))
       {
-        ret = -1;
-        palloc_free_page (kpage);
-        return ret;
+        vm_unpin (ubuf, cur_write);
+        return -1;
       }
-      if(inode_isDir(file_get_inode(write)))
-      {
-        ret = -1;
-        palloc_free_page (kpage);
-        return ret;
-      }      
-      result = file_write (write, kpage, cur_write);
-//    printf (" WRITTEN : %d", result);
-  }
-  to_write = to_write - cur_write;
-  ret += result;
+      result = file_write (write, ubuf, cur_write);
+    }
+    vm_unpin (ubuf, cur_write);
+    ret += result;
+    if ((unsigned) result < cur_write)
+      break;
   }
-  palloc_free_page (kpage);
   return ret;
 }
 
@@ -257,14 +222,13 @@ void close (int fd)
         
   }
   
-  struct fd_table_element *fd_elem = find_file (fd);
-  if (fd_elem == NULL)
+  struct file *fd_file = find_file (fd);
+  if (fd_file == NULL)
   //  goto done;
     return;
   else
   {
-    file_close (fd_elem -> file_name);
-    list_remove (&fd_elem -> file_elem);
+    file_close (fd_file);
   }
     entry_remove (fd);
    // lock_release(&file_lock);
@@ -273,79 +237,47 @@ void close (int fd)
 /* If the fd corresponds to directory then it must fail */ 
 int read (int fd, void* buffer, unsigned length)
 {
-//  lock_acquire(&file_lock);
   int result = 0;
   int ret = 0;
+  unsigned done, cur_read;
   if (fd < 0 || (fd == STDOUT_FILENO && thread_current() -> fd_std_out) 
       || (fd == 2 && thread_current() -> fd_std_err))
   {
     return -1;
   }
-  //~ if (length = PGSIZE)
-  //~ printf ("Read : fd %d length %d \n", fd, length);
-  int num_of_pages = length/PGSIZE;
-  int to_read = length;
-  int cur_read = 0;
-  int i = 0;
-  bool valid;
-  valid = validate_buffer (buffer, NULL, length, true);
-  if (!valid)
-  {
-    //thread_exit (-1);
-    on_pgfault ();
-    NOT_REACHED ();
-  }
-  void *kpage = palloc_get_page (PAL_ASSERT);
-  //~ printf ("Read : fd %d length %d no: %d\n", fd, length, num_of_pages);
-  for (i = 0; i <= num_of_pages; i++)
-  {
-    if (to_read / PGSIZE == 0)
-      to_read = to_read % PGSIZE;
 
-    if (to_read == 0)
+  /* The buffer is read into in place, a chunk at a time pinned. */
+  for (done = 0; done < length; done += cur_read)
+  {
+    char *ubuf = (char *) buffer + done;
+    cur_read = length - done < PIN_MAX_BYTES ? length - done : PIN_MAX_BYTES;
+    if (!vm_pin (ubuf, cur_read, true))
     {
-      //~ printf ("break in iteration %d \n", i);
-      //palloc_free_page (kpage);
-      //~ printf ("exiting %d res %d\n", fd, ret); 
-      break;
+      on_pgfault ();
+      NOT_REACHED ();
     }
-    cur_read = (to_read > PGSIZE) ? PGSIZE : to_read;
-    // printf ("Reading : fd %d length %d cur %d  toread %d validating %d \n", fd, length, cur_read, to_read, (length - to_read));
     if (fd == STDIN_FILENO && thread_current() -> fd_std_in)
     {
-      int i = 0;
-      while (i < cur_read)
-        *(uint8_t *)(kpage + i) = input_getc();
-       result = cur_read;
-      // continue;
+      unsigned i;
+      for (i = 0; i < cur_read; i++)
+        ubuf[i] = input_getc ();
+      result = cur_read;
     }
     else
     {
-      struct fd_table_element *fd_elem = find_file (fd);
-      if (fd_elem == NULL)
-      {
-        palloc_free_page (kpage);
-        return -1;
-      }
-      struct file * read = fd_elem -> file_name;
-      if(read == NULL)
+      struct file * read = find_file (fd);
+      if (read == NULL || inode_isDir (file_get_inode (read)))
       {
-        palloc_free_page (kpage);
+        vm_unpin (ubuf, cur_read);
         return -1;
       }
-      if(inode_isDir(file_get_inode(read)))
-      {
-        palloc_free_page (kpage);
-        return -1;
-      }
-      result = file_read (read, kpage, cur_read);
-      //~ printf ("Read %d from fd %d length%d\n", result, fd, length);
+      result = file_read (read, ubuf, cur_read);
     }
-    memcpy (buffer + (length - to_read), kpage, cur_read);
-    to_read = to_read - cur_read;
+    vm_unpin (ubuf, cur_read);
     ret += result;
+    if ((unsigned) result < cur_read)
+      break;
   }
-  palloc_free_page (kpage);
   return ret;
 }
 
@@ -392,13 +324,13 @@ int filesize (int fd)
     result = 0;
     goto done;
   }
-  struct fd_table_element *fd_elem = find_file (fd);
-  if (fd_elem == NULL)
+  struct file *fd_file = find_file (fd);
+  if (fd_file == NULL)
   {
     result = 0;
     goto done;
   }
-  result = file_length (fd_elem -> file_name);
+  result = file_length (fd_file);
   done:
    // lock_release(&file_lock);
   return result;
@@ -411,9 +343,9 @@ void seek (int fd, unsigned position)
    // goto done;
    return;
    //    printf ("am I here???"); 
-    struct fd_table_element *fd_elem = find_file (fd);
-    if (fd_elem != NULL)
-      file_seek (fd_elem -> file_name, position);
+    struct file *fd_file = find_file (fd);
+    if (fd_file != NULL)
+      file_seek (fd_file, position);
  // lock_release(&file_lock);  
 }
 
@@ -426,13 +358,13 @@ unsigned tell (int fd)
     result = 0;
     goto done;
   }
-  struct fd_table_element *fd_elem = find_file (fd);
-  if (fd_elem == NULL)
+  struct file *fd_file = find_file (fd);
+  if (fd_file == NULL)
   {
     result = 0;
     goto done;
   }
-  result = file_tell (fd_elem -> file_name);
+  result = file_tell (fd_file);
   done:
   //  lock_release(&file_lock);
   return result;
@@ -448,12 +380,12 @@ mapid_t mmap (int fd, void *addr)
       || (fd == STDIN_FILENO && thread_current() -> fd_std_in) 
       || (fd == 2 && thread_current() -> fd_std_err))
     return -1;
-  struct fd_table_element *fd_elem = find_file (fd);
-  if (fd_elem == NULL)
+  struct file *fd_file = find_file (fd);
+  if (fd_file == NULL)
     return -1;
   if ((uint32_t)addr % PGSIZE != 0) /* not aligned properly*/
     return -1;
-  struct file* file = file_reopen (fd_elem -> file_name);
+  struct file* file = file_reopen (fd_file);
   ASSERT(file != NULL)
   mapid_t result = vm_mmap (file, addr); 
   return result;
@@ -465,6 +397,94 @@ void munmap (mapid_t mapping)
   return;
 }
 
+void msync (mapid_t mapping)
+{
+  vm_msync (mapping);
+}
+
+bool madvise (void *addr, unsigned length, int advice)
+{
+  return vm_madvise (addr, length, advice);
+}
+
+bool memstat (struct memstat *stat)
+{
+  if (!vm_pin (stat, sizeof *stat, true))
+  {
+    on_pgfault ();
+    NOT_REACHED ();
+  }
+  struct thread *cur = thread_current ();
+  struct memstat kstat;
+  lock_acquire (&cur -> pagedir_lock);
+  kstat.rss = cur -> rss;
+  kstat.working_set = evict_working_set (cur);
+  kstat.rss_limit = cur -> rss_limit;
+  lock_release (&cur -> pagedir_lock);
+  *stat = kstat;
+  vm_unpin (stat, sizeof *stat);
+  return true;
+}
+
+/* Limits the resident pages of the current process to PAGES, 0 lifts
+   the limit. Pages above the limit are reclaimed by later faults. */
+bool set_rss_limit (int pages)
+{
+  if (pages < 0)
+    return false;
+  thread_current () -> rss_limit = pages;
+  return true;
+}
+
+/* Copies up to CNT of the most recent page faults of all processes to
+   EVENTS, oldest first, and returns how many were copied. */
+int vmtrace (struct vmtrace_event *events, int cnt)
+{
+  if (cnt <= 0)
+    return 0;
+  if (cnt > VM_TRACE_SIZE)
+    cnt = VM_TRACE_SIZE;
+  /* Pinning takes any faults on EVENTS before the trace is read,
+     so the copy neither faults nor traces itself. */
+  size_t size = cnt * sizeof *events;
+  if (!vm_pin (events, size, true))
+  {
+    on_pgfault ();
+    NOT_REACHED ();
+  }
+  cnt = vm_trace_copy (events, cnt);
+  vm_unpin (events, size);
+  return cnt;
+}
+
+/* Adds INCREMENT to the niceness of the current process, within
+   NICE_MIN...NICE_MAX, and returns the new niceness.  Nicer
+   processes lose priority under the MLFQS. */
+int nice (int increment)
+{
+  int cur = thread_get_nice ();
+  if (increment > NICE_MAX - cur)
+    increment = NICE_MAX - cur;
+  else if (increment < NICE_MIN - cur)
+    increment = NICE_MIN - cur;
+  thread_set_nice (cur + increment);
+  return thread_get_nice ();
+}
+
+/* Returns 100 times the system load average, which is only tracked
+   under the MLFQS. */
+int get_load_avg (void)
+{
+  return thread_get_load_avg ();
+}
+
+/* Returns 100 times the recent CPU use of the current process,
+   which is only tracked under the MLFQS. */
+int get_recent_cpu (void)
+{
+  return thread_get_recent_cpu ();
+}
+
 bool 
 chdir(const char *file_name)
 {
@@ -507,6 +527,7 @@ readdir(int fd, char *file_name)
 
  // lock_acquire(&file_lock);
   bool result = 0;
+  bool pinned = false;
   if (fd < 0 || (fd == STDOUT_FILENO && thread_current() -> fd_std_out) 
       || (fd == 2 && thread_current() -> fd_std_err)
       || (fd == STDIN_FILENO && thread_current() -> fd_std_in))
@@ -514,9 +535,8 @@ readdir(int fd, char *file_name)
     result = false;
     goto done;
   }
-  bool valid;
-  valid = validate_buffer (file_name, NULL, NAME_MAX+1 , true);
-  if (!valid)
+  pinned = vm_pin (file_name, NAME_MAX + 1, true);
+  if (!pinned)
   {
     printf("buffer invalid\n");
   //  lock_release (&file_lock);
@@ -524,12 +544,12 @@ readdir(int fd, char *file_name)
     NOT_REACHED ();
   }
 
-  struct fd_table_element *fd_elem = find_file (fd);
-  if (fd_elem == NULL){
+  struct file *fd_file = find_file (fd);
+  if (fd_file == NULL){
     printf("fd not found\n");
     goto done;
   }
-  struct file * read = fd_elem -> file_name;
+  struct file * read = fd_file;
   if (read == NULL)
   {
     printf("file empty\n");
@@ -554,7 +574,8 @@ readdir(int fd, char *file_name)
   done:
   //dir_close(dir);
 //  lock_release(&file_lock);
-    
+  if (pinned)
+    vm_unpin (file_name, NAME_MAX + 1);
   return result;
   
 }
@@ -572,10 +593,10 @@ isdir(int fd)
     goto done;
   }
   
-  struct fd_table_element *fd_elem = find_file (fd);
-  if (fd_elem == NULL)
+  struct file *fd_file = find_file (fd);
+  if (fd_file == NULL)
     goto done;
-  struct file * read = fd_elem -> file_name;
+  struct file * read = fd_file;
   if (read == NULL)
   {
       goto done;
@@ -601,10 +622,10 @@ int inumber(int fd)
     goto done;
   }
   
-  struct fd_table_element *fd_elem = find_file (fd);
-  if (fd_elem == NULL)
+  struct file *fd_file = find_file (fd);
+  if (fd_file == NULL)
     goto done;
-  struct file * read = fd_elem -> file_name;
+  struct file * read = fd_file;
   if (read == NULL)
   {
       result = -1;
@@ -710,6 +731,46 @@ syscall_handler (struct intr_frame *f)
         on_pgfault();
       munmap ((mapid_t) arg0);
       break;
+    case SYS_MSYNC:
+      if (!arg0_valid)
+        on_pgfault();
+      msync ((mapid_t) arg0);
+      break;
+    case SYS_MADVISE:
+      if (!arg0_valid || !arg1_valid || !arg2_valid)
+        on_pgfault();
+      result = (int) madvise ((void *) arg0, (unsigned) arg1, (int) arg2);
+      break;
+    case SYS_MEMSTAT:
+      if (!arg0_valid)
+        on_pgfault();
+      result = (int) memstat ((struct memstat *) arg0);
+      break;
+    case SYS_SET_RSS_LIMIT:
+      if (!arg0_valid)
+        on_pgfault();
+      result = (int) set_rss_limit ((int) arg0);
+      break;
+    case SYS_VMTRACE:
+      if (!arg0_valid || !arg1_valid)
+        on_pgfault();
+      result = vmtrace ((struct vmtrace_event *) arg0, arg1);
+      break;
+    case SYS_FORK:
+      /* The child returns 0 from the same call. */
+      result = (int) process_fork (f);
+      break;
+    case SYS_NICE:
+      if (!arg0_valid)
+        on_pgfault();
+      result = nice ((int) arg0);
+      break;
+    case SYS_GET_LOAD_AVG:
+      result = get_load_avg ();
+      break;
+    case SYS_GET_RECENT_CPU:
+      result = get_recent_cpu ();
+      break;
     case SYS_CHDIR:
       if (!arg0_valid)
         on_pgfault();
@@ -11,6 +11,43 @@ typedef int pid_t;
 #define PID_ERROR ((pid_t) -1)
 
 
+/* Access hints for madvise(). */
+#define MADV_NORMAL 0           /* No special treatment. */
+#define MADV_RANDOM 1           /* Expect random accesses. */
+#define MADV_SEQUENTIAL 2       /* Expect sequential accesses. */
+#define MADV_WILLNEED 3         /* Will be accessed soon. */
+#define MADV_DONTNEED 4         /* Will not be accessed soon. */
+#define MADV_HUGEPAGE 5         /* Map with 4 MB pages where possible. */
+#define MADV_NOHUGEPAGE 6       /* Map with 4 KB pages only. */
+
+/* Memory usage reported by memstat(), in pages. */
+struct memstat
+  {
+    int rss;                    /* Resident pages. */
+    int working_set;            /* Pages recently used. */
+    int rss_limit;              /* Resident limit, 0 if unlimited. */
+  };
+
+/* Types of page faults reported by vmtrace(). */
+#define VM_FAULT_ZERO 0         /* Zero filled page. */
+#define VM_FAULT_STACK 1        /* New stack page. */
+#define VM_FAULT_FILE 2         /* Read from a file. */
+#define VM_FAULT_SWAP 3         /* Read back from swap. */
+#define VM_FAULT_SHARED 4       /* Frame shared with other processes. */
+#define VM_FAULT_COW 5          /* Store to a copy-on-write page. */
+#define VM_FAULT_MINOR 6        /* Frame was resident already. */
+#define VM_FAULT_TYPE_CNT 7
+
+/* A page fault reported by vmtrace(). */
+struct vmtrace_event
+  {
+    void *addr;                 /* Faulting page. */
+    int type;                   /* VM_FAULT_*. */
+    int pid;                    /* Faulting process. */
+    unsigned cycles;            /* Time taken to serve it. */
+    void *victim;               /* Page evicted to serve it, or NULL. */
+  };
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
@@ -36,6 +73,14 @@ void close (int fd);
 /* Project 3 and optionally project 4. */
 mapid_t mmap (int fd, void *addr);
 void munmap (mapid_t);
+void msync (mapid_t);
+bool madvise (void *addr, unsigned length, int advice);
+bool memstat (struct memstat *);
+bool set_rss_limit (int pages);
+int vmtrace (struct vmtrace_event *, int cnt);
+int nice (int increment);
+int get_load_avg (void);
+int get_recent_cpu (void);
 
 /* Project 4 only. */
 bool chdir (const char *dir);
@@ -4,13 +4,24 @@
 #include "userprog/pagedir.h"
 #include "vm/swap.h"
 #include "vm/clock.h"
+#include "vm/trace.h"
+#include "vm/zswap.h"
 #include "filesys/file.h"
 #include "threads/malloc.h"
 #include "threads/interrupt.h"
+#include <stdio.h>
 
 /* Current position of the clock hand. */
 struct list_elem * cur_frame_elem;
-static inline enum frame_location evict_to (struct frame *frame);
+/* Number of times the clock's hand went round the frame list. */
+static unsigned sweep_cnt;
+static inline enum frame_location evict_to (struct frame *frame, bool dirty);
+static struct list_elem *evict_advance (struct list *frame_list,
+                                        struct list_elem *e);
+static struct frame *evict_scan (struct list *frame_list, tid_t owner);
+static bool evict_owned_by (struct frame *frame, tid_t owner);
+static void evict_note_access (struct thread *t);
+static void evict_restore (struct frame *frame, bool dirty);
 
 /*
  * Initialize the eviction
@@ -23,19 +34,51 @@ evict_init ()
 
 /* Evicts a frame from the physical memory to the swap space.
    The evicted frame is removed from the frame list. This function
-   returns the frame that succeeds the evicted frame. */
+   returns the frame that succeeds the evicted frame. If OWNER is not
+   TID_ERROR only frames mapped by OWNER are considered. NULL is
+   returned if no frame can be evicted. Frames mapped only by processes
+   above their resident limit are evicted even if recently used. */
 struct frame *
-evict_frame (struct list * frame_list)
+evict_frame (struct list * frame_list, tid_t owner)
 {
-  if (!has_swap())
+  intr_watch (true);
+  struct frame *frame = evict_scan (frame_list, owner);
+  intr_watch (false);
+  return frame;
+}
+
+/*
+ * Prints the longest time eviction kept the interrupts off.
+ */
+void
+evict_print_stats (void)
+{
+  printf ("Eviction: %llu cycles longest with interrupts off\n",
+          intr_watch_longest ());
+}
+
+/* Runs the clock for evict_frame(). The accessed and dirty bits of
+   the pages mapping a frame are harvested under the locks of their
+   address spaces, interrupts stay on. */
+static struct frame *
+evict_scan (struct list * frame_list, tid_t owner)
+{
+  if (!has_swap() && !zswap_enabled ())
     return NULL;
   ASSERT (!list_empty (frame_list));
   struct frame * frame = NULL;
+  /* Twice round is enough to clear the accessed bits and then find
+     an unused page. If that fails, every frame is pinned or could
+     not be written out, and the caller fails the allocation. */
+  size_t scan_max = 2 * list_size (frame_list) + 1;
+  size_t scanned = 0;
   
   /* Traverse the frame list in circle until a frame is found for eviction. */
   for (cur_frame_elem = ((cur_frame_elem == NULL || cur_frame_elem == list_end(frame_list)) ? list_front (frame_list) : cur_frame_elem) ;
-      ; cur_frame_elem = ((cur_frame_elem == list_back (frame_list))? list_front (frame_list) : list_next (cur_frame_elem)) )
+      ; cur_frame_elem = evict_advance (frame_list, cur_frame_elem))
   {
+    if (scanned++ == scan_max)
+      return NULL;
     frame = list_entry (cur_frame_elem, struct frame, elem);
     ASSERT(frame -> magic == 0x00345678);
     lock_acquire (&frame -> lk);
@@ -44,43 +87,53 @@ evict_frame (struct list * frame_list)
       cur_frame_elem = list_next(cur_frame_elem);
       return frame;
     }
+    if (frame -> pin_cnt > 0
+        || (owner != TID_ERROR && !evict_owned_by (frame, owner)))
+    {
+      lock_release (&frame -> lk);
+      continue;
+    }
     struct list_elem * e;
     bool accessed = false;
     bool dirty = false;
+    bool over_limit = true;
     /* There must be some user tracking this frame. Otherwise this frame 
        had already been removed from the frame list. */ 
 
      ASSERT (!list_empty(&frame->user_list));
-    int old_level = intr_disable(); 
     /* Set the accessed bit to 0 for all the pages mapping this frame. */
     for (e = list_begin (&frame -> user_list); e != list_end (&frame -> user_list); e = list_next(e))
     {
       struct user *user = list_entry (e, struct user, elem);
-      struct thread * t = get_thread (user -> tid);
-      if (t != NULL)
+      struct thread * t = user -> thread;
+      lock_acquire (&t -> pagedir_lock);
+      if (t -> pagedir != NULL)
       {
-        accessed |= pagedir_is_accessed (t -> pagedir, user -> vaddr);
+        if (pagedir_is_accessed (t -> pagedir, user -> vaddr))
+        {
+          accessed = true;
+          evict_note_access (t);
+        }
         dirty |= pagedir_is_dirty (t -> pagedir, user -> vaddr);
+        over_limit &= t -> rss_limit != 0 && t -> rss > t -> rss_limit;
+        pagedir_set_accessed (t -> pagedir, user -> vaddr, false);
       }
-      pagedir_set_accessed (t -> pagedir, user -> vaddr, false);
+      lock_release (&t -> pagedir_lock);
     }
-    intr_set_level (old_level);
     /* The frame was not recently accessed. */
-    if (!accessed)
+    if (!accessed || over_limit)
     {
-      int old_level = intr_disable();
       /* Mark the pages using FRAME as not present, anymore. */
       for (e = list_begin (&frame -> user_list); e != list_end (&frame -> user_list); e = list_next(e))
       {
         struct user *user = list_entry (e, struct user, elem);
-        struct thread * t = get_thread (user -> tid);
-        if (t != NULL)
-        {
-          /* Mark the pages using this frame as not present. */
+        struct thread * t = user -> thread;
+        lock_acquire (&t -> pagedir_lock);
+        /* Mark the pages using this frame as not present. */
+        if (t -> pagedir != NULL)
           pagedir_clear_page (t -> pagedir, user -> vaddr);
-        }
+        lock_release (&t -> pagedir_lock);
       }
-      intr_set_level (old_level);
       /* Move the clock's hand to the next frame. */
       struct list_elem *temp_hand = list_next (cur_frame_elem);
       /* Insert a new frame in place of evicted frame. */
@@ -90,10 +143,10 @@ evict_frame (struct list * frame_list)
       /* Evict the frame from the frame list. */
 
       bool swapped = false;
-      enum frame_location evict_loc = evict_to (frame);      
+      enum frame_location evict_loc = evict_to (frame, dirty);
       if (evict_loc == FILE_SYS)
       {
-        uint32_t bytes = file_write_at (frame -> file, ptov ((uintptr_t) frame -> addr), PGSIZE, frame -> ofs); 
+        uint32_t bytes = file_write_at (frame -> file, ptov ((uintptr_t) frame -> addr), frame -> read_bytes, frame -> ofs); 
         if (bytes != 0)
         {
           swapped = true;
@@ -118,19 +171,32 @@ evict_frame (struct list * frame_list)
       /* Swap was unsuccessful. Return the unmodified list. */
       if (!swapped)
       {
+        evict_restore (frame, dirty);
         list_insert (list_remove (&new_frame -> elem), &frame -> elem);
+        lock_release (&new_frame -> lk);
         free (new_frame);
         lock_release (&frame -> lk);
         /* If swapping was not successful, due to eviction of mmap page
-           try again else return error. */
-          if (frame -> mmapped)
+           or a page the compressed pool rejected with no swap device
+           behind it, try again else return error. */
+        if (frame -> mmapped || !has_swap ())
           continue;
         else
           return NULL; 
       }
         cur_frame_elem = temp_hand;
+      /* The pages are no longer resident. */
+      for (e = list_begin (&frame -> user_list); e != list_end (&frame -> user_list); e = list_next(e))
+      {
+        struct thread *t = list_entry (e, struct user, elem) -> thread;
+        lock_acquire (&t -> pagedir_lock);
+        t -> rss--;
+        lock_release (&t -> pagedir_lock);
+      }
       /* Swap was successful. Return the frame next to the evicted 
          frame in the original fram list. */
+      vm_trace_note_victim (list_entry (list_front (&frame -> user_list),
+                                        struct user, elem) -> vaddr);
       lock_release (&frame -> lk);
       return new_frame;
     }
@@ -139,18 +205,111 @@ evict_frame (struct list * frame_list)
 }
 
 /*
- * Frequently used function thus inlined
+ * Maps FRAME again for all of its users after a failed eviction
+ * cleared their pages, keeping them DIRTY if they were.
+ */
+static void
+evict_restore (struct frame *frame, bool dirty)
+{
+  struct list_elem *e;
+  for (e = list_begin (&frame -> user_list); e != list_end (&frame -> user_list); e = list_next(e))
+  {
+    struct user *user = list_entry (e, struct user, elem);
+    struct thread *t = user -> thread;
+    lock_acquire (&t -> pagedir_lock);
+    if (t -> pagedir != NULL)
+    {
+      pagedir_set_page (t -> pagedir, user -> vaddr,
+                        ptov ((uintptr_t) frame -> addr),
+                        frame -> writable && !frame -> cow);
+      pagedir_set_dirty (t -> pagedir, user -> vaddr, dirty);
+    }
+    lock_release (&t -> pagedir_lock);
+  }
+}
+
+/*
+ * Moves the clock's hand off FRAME, which is leaving the frame list.
+ */
+void
+evict_skip (struct frame *frame)
+{
+  if (cur_frame_elem == &frame -> elem)
+    cur_frame_elem = list_next (cur_frame_elem);
+}
+
+/*
+ * Returns the estimated working set of T: the number of its pages
+ * found recently used during the last full round of the clock. Until
+ * the clock went round once all resident pages are counted.
+ */
+int
+evict_working_set (struct thread *t)
+{
+  if (sweep_cnt == 0)
+    return t -> rss;
+  if (t -> ws_sweep == sweep_cnt)
+    return t -> ws_size;
+  if (t -> ws_sweep + 1 == sweep_cnt)
+    return t -> ws_hits;
+  return 0;
+}
+
+/*
+ * Moves the clock's hand from E to the next frame.
+ */
+static struct list_elem *
+evict_advance (struct list *frame_list, struct list_elem *e)
+{
+  if (e == list_back (frame_list))
+  {
+    sweep_cnt++;
+    return list_front (frame_list);
+  }
+  return list_next (e);
+}
+
+/*
+ * Returns true if OWNER maps FRAME.
+ */
+static bool
+evict_owned_by (struct frame *frame, tid_t owner)
+{
+  struct list_elem *e;
+  for (e = list_begin (&frame -> user_list); e != list_end (&frame -> user_list); e = list_next (e))
+    if (list_entry (e, struct user, elem) -> tid == owner)
+      return true;
+  return false;
+}
+
+/*
+ * Counts a page of T found used by the clock. The counts of the
+ * previous round are kept as the working set estimate. Should be
+ * called with T's pagedir_lock acquired.
+ */
+static void
+evict_note_access (struct thread *t)
+{
+  if (t -> ws_sweep != sweep_cnt)
+  {
+    t -> ws_size = t -> ws_sweep + 1 == sweep_cnt ? t -> ws_hits : 0;
+    t -> ws_hits = 0;
+    t -> ws_sweep = sweep_cnt;
+  }
+  t -> ws_hits++;
+}
+
+/*
+ * Frequently used function thus inlined. DIRTY tells whether one
+ * of the pages mapping FRAME was written to.
  */
 static inline enum frame_location
-evict_to (struct frame *frame)
+evict_to (struct frame *frame, bool dirty)
 {
   enum frame_location loc;
-  struct thread *t = thread_current();
-  void *upage = ptov ((uint32_t)(frame -> addr));
-  bool dirty = pagedir_is_dirty ((uint32_t *) (t -> pagedir), (const void *) upage);
   if (frame -> mmapped && dirty)
   {
-    loc = FILESYS;
+    loc = FILE_SYS;
   }
   else if ((frame -> mmapped && !dirty) || (!frame -> mmapped && !frame -> writable))
   {
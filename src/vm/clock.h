@@ -1,5 +1,9 @@
 #ifndef VM_CLOCK_H
 #define VM_CLOCK_H
+#include "threads/thread.h"
 void evict_init (void);
-struct frame* evict_frame (struct list *);
+struct frame* evict_frame (struct list *, tid_t owner);
+int evict_working_set (struct thread *);
+void evict_skip (struct frame *);
+void evict_print_stats (void);
 #endif
@@ -10,10 +10,17 @@
 #include "vm/swap.h"
 #include "filesys/file.h"
 #include "lib/string.h"
+#include "lib/stdlib.h"
 #include "threads/interrupt.h"
 
 struct list frame_list;  /* List of frames currently in memory. */
 
+static struct frame *frame_alloc_free (enum palloc_flags);
+static void frame_clear_dirty (struct frame *frame);
+static void frame_rss_add (struct thread *t, int cnt);
+static int frame_file_order (const void *, const void *);
+void *zero_page;         /* Shared read-only page of zeros. */
+
 /*
  * Initialize our frame table and lock
  */
@@ -21,6 +28,7 @@ void frame_init (void)
 {
   list_init (&frame_list);
   lock_init (&frame_list_lock); 
+  zero_page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   evict_init ();
 }
 
@@ -50,18 +58,18 @@ frame_alloc_lockless (enum palloc_flags flags)
   /* Allocating a frame for the user. */ 
   if (flags & PAL_USER)
   {
-    page = palloc_get_page (flags);
-    /* user pool not yet empty */
-    if (page != NULL)
-    {
-      frame = frame_create ((void *) vtop (page));
-      list_push_back (&frame_list, &frame -> elem);
-    }
+    /* A process at its resident limit replaces one of its own
+       pages instead of taking a page from the others. */
+    struct thread *cur = thread_current ();
+    if (cur -> rss_limit != 0 && cur -> rss >= cur -> rss_limit)
+      frame = evict_frame (&frame_list, cur -> tid);
+    if (frame == NULL)
+      frame = frame_alloc_free (flags);
     /* evict a frame if user pool is empty */
-    else
+    if (frame == NULL)
     {
 //      printf ("Evicting a frame for use \n");
-      frame = evict_frame (&frame_list);
+      frame = evict_frame (&frame_list, TID_ERROR);
     }
   }
   /* Allocating a frame for the kernel. */
@@ -76,6 +84,33 @@ frame_alloc_lockless (enum palloc_flags flags)
   return frame;
 }
 
+/* Allocates a user frame only if one is free, without evicting.
+   Returns NULL otherwise. */
+struct frame *
+frame_try_alloc (enum palloc_flags flags)
+{
+  ASSERT (flags & PAL_USER);
+  lock_acquire (&frame_list_lock);
+  struct frame *f = frame_alloc_free (flags);
+  lock_release (&frame_list_lock);
+  return f;
+}
+
+/* Takes a page from the user pool. Should be called with
+   FRAME_LOCK acquired. */
+static struct frame *
+frame_alloc_free (enum palloc_flags flags)
+{
+  struct frame *frame = NULL;
+  void *page = palloc_get_page (flags);
+  /* user pool not yet empty */
+  if (page != NULL)
+    frame = frame_create ((void *) vtop (page));
+  if (frame != NULL)
+    list_push_back (&frame_list, &frame -> elem);
+  return frame;
+}
+
 /*
  * Creates a frame and initializes it
  */
@@ -87,6 +122,9 @@ frame_create (void *addr)
   frame -> untracked = true;
   frame -> in_swap = false;
   frame -> untracked = true;
+  frame -> cow = false;
+  frame -> pin_cnt = 0;
+  frame -> released = false;
   frame -> magic = 0x00345678;
   lock_init (&frame -> lk);
   list_init (&frame -> user_list);
@@ -128,12 +166,28 @@ frame_dealloc (struct frame *frame, void *vaddr)
         if (dirty)
           file_write_at (frame -> file, ptov((uintptr_t)frame -> addr), frame -> read_bytes, frame -> ofs);
       }
-      lock_release (&frame -> lk);
+      /* Give the page back to the pool it came from, so that
+         palloc can coalesce it. */
+      evict_skip (frame);
+      list_remove (&frame -> elem);
+      if (frame -> pin_cnt > 0)
+      {
+        /* Someone still reads the page, frame_unpin() frees it. */
+        frame -> released = true;
+        lock_release (&frame -> lk);
+      }
+      else
+      {
+        palloc_free_page (ptov ((uintptr_t) frame -> addr));
+        lock_release (&frame -> lk);
+        free (frame);
+      }
       lock_release (&frame_list_lock);
       return true;
     }
     else
     {
+      lock_release (&frame -> lk);
       /* Means the frame is in swap. */
       if (frame_loc == SWAP)
       {
@@ -165,8 +219,11 @@ frame_track (struct frame * frame_, void *vaddr)
   ASSERT (frame_ != NULL);
   struct user *user = (struct user *) malloc (sizeof(struct user));
   user -> tid = thread_tid();
+  user -> thread = thread_current ();
   user -> vaddr = vaddr;
   list_push_back (&frame_ -> user_list, &user -> elem);
+  if (!frame_ -> in_swap)
+    frame_rss_add (thread_current (), 1);
 }
 
 void
@@ -183,6 +240,8 @@ frame_untrack (struct frame * frame, void *vaddr)
     if (user -> tid == tid && ( vaddr == NULL || vaddr == user -> vaddr))
     {
       pagedir_clear_page (pd, user -> vaddr);
+      if (!frame -> in_swap)
+        frame_rss_add (thread_current (), -1);
       struct list_elem *next = list_remove (e);
       free (user);
       e = list_prev (next);
@@ -242,18 +301,21 @@ frame_in (struct frame *f)
     }
     list_insert (&to -> elem, &f -> elem);
     list_remove (&to -> elem);
+    lock_release (&to -> lk);
     free (to);
-    int old_level = intr_disable();
     struct list_elem *e;
     for (e = list_begin (&f -> user_list); e != list_end (&f -> user_list); e = list_next (e))
     {
       struct user *user = list_entry (e, struct user, elem);
-
-      struct thread *t = get_thread (user -> tid);
-      /* Writable atgument doesn't matter. */
-      pagedir_set_page (t -> pagedir, user -> vaddr, ptov((uint32_t)f -> addr), f -> writable);
+      struct thread *t = user -> thread;
+      lock_acquire (&t -> pagedir_lock);
+      /* Copy-on-write frames stay read-only for all of their users. */
+      if (t -> pagedir != NULL)
+        pagedir_set_page (t -> pagedir, user -> vaddr, ptov((uint32_t)f -> addr),
+                          f -> writable && !f -> cow);
+      t -> rss++;
+      lock_release (&t -> pagedir_lock);
     }
-    intr_set_level (old_level);
     lock_release (&f -> lk);
     lock_release (&frame_list_lock);
     return true;
@@ -270,17 +332,176 @@ frame_is_dirty (struct frame *frame)
   ASSERT (frame != NULL);
   ASSERT (lock_held_by_current_thread (&frame -> lk));
   ASSERT (!frame -> in_swap);
-  int old_level = intr_disable();
   bool dirty = false;    
   struct list_elem *e;
   for (e = list_begin (&frame -> user_list); e != list_end (&frame -> user_list); e = list_next (e))
   {
    struct user *user = list_entry (e, struct user, elem);
-   struct thread *t = get_thread (user -> tid);
-   dirty |= pagedir_is_dirty (t -> pagedir, user -> vaddr);
+   struct thread *t = user -> thread;
+   lock_acquire (&t -> pagedir_lock);
+   if (t -> pagedir != NULL)
+     dirty |= pagedir_is_dirty (t -> pagedir, user -> vaddr);
+   lock_release (&t -> pagedir_lock);
    if (dirty)
    break;
    }
-  intr_set_level (old_level);
   return dirty;
 }
+
+/*
+ * Clears the dirty bit of every page mapping FRAME.
+ */
+static void
+frame_clear_dirty (struct frame *frame)
+{
+  ASSERT (lock_held_by_current_thread (&frame -> lk));
+  struct list_elem *e;
+  for (e = list_begin (&frame -> user_list); e != list_end (&frame -> user_list); e = list_next (e))
+  {
+    struct user *user = list_entry (e, struct user, elem);
+    struct thread *t = user -> thread;
+    lock_acquire (&t -> pagedir_lock);
+    if (t -> pagedir != NULL)
+      pagedir_set_dirty (t -> pagedir, user -> vaddr, false);
+    lock_release (&t -> pagedir_lock);
+  }
+}
+
+/*
+ * Drops a pin taken on FRAME with its lock held, freeing FRAME if
+ * its last user released it meanwhile.
+ */
+void
+frame_unpin (struct frame *frame)
+{
+  lock_acquire (&frame -> lk);
+  ASSERT (frame -> pin_cnt > 0);
+  if (--frame -> pin_cnt == 0 && frame -> released)
+  {
+    palloc_free_page (ptov ((uintptr_t) frame -> addr));
+    lock_release (&frame -> lk);
+    free (frame);
+    return;
+  }
+  lock_release (&frame -> lk);
+}
+
+/*
+ * Writes FRAME, a mmap frame, back to its file if it was dirtied
+ * since the last write back. Returns true if it was written. The
+ * frame is pinned rather than locked during the write, so the clock
+ * and page faults do not wait on the disk.
+ */
+bool
+frame_writeback (struct frame *frame)
+{
+  struct file *file = NULL;
+  ASSERT (frame -> mmapped);
+  lock_acquire (&frame -> lk);
+  if (!frame -> in_swap && frame_is_dirty (frame))
+  {
+    /* An own handle outlives a munmap() meanwhile. */
+    file = file_reopen (frame -> file);
+    if (file != NULL)
+    {
+      /* Stores made while the page is written set the bits again. */
+      frame_clear_dirty (frame);
+      frame -> pin_cnt++;
+    }
+  }
+  lock_release (&frame -> lk);
+  if (file == NULL)
+    return false;
+  file_write_at (file, ptov ((uintptr_t) frame -> addr),
+                 frame -> read_bytes, frame -> ofs);
+  file_close (file);
+  frame_unpin (frame);
+  return true;
+}
+
+/*
+ * Writes back the CNT mmap frames in FRAMES, sorted by file and
+ * offset so that the disk sees them in order.
+ */
+void
+frame_writeback_sorted (struct frame **frames, size_t cnt)
+{
+  size_t i;
+  qsort (frames, cnt, sizeof *frames, frame_file_order);
+  for (i = 0; i < cnt; i++)
+    frame_writeback (frames[i]);
+}
+
+/*
+ * Writes back every dirty mmap frame in memory. Used by the
+ * periodic writer so that long-lived mappings do not keep all of
+ * their stores until they are unmapped. The lock on frame list is
+ * held only to pick and pin the frames, not during the writes.
+ */
+void
+frame_writeback_all (void)
+{
+  struct list_elem *e;
+  size_t cnt = 0, i;
+  lock_acquire (&frame_list_lock);
+  for (e = list_begin (&frame_list); e != list_end (&frame_list); e = list_next (e))
+    if (list_entry (e, struct frame, elem) -> mmapped)
+      cnt++;
+  struct frame **frames = cnt != 0 ? malloc (cnt * sizeof *frames) : NULL;
+  if (frames == NULL)
+  {
+    lock_release (&frame_list_lock);
+    return;
+  }
+  cnt = 0;
+  for (e = list_begin (&frame_list); e != list_end (&frame_list); e = list_next (e))
+  {
+    struct frame *frame = list_entry (e, struct frame, elem);
+    if (!frame -> mmapped)
+      continue;
+    /* A pin keeps the frame from being evicted or freed until it
+       has been written. */
+    lock_acquire (&frame -> lk);
+    if (!frame -> in_swap)
+    {
+      frame -> pin_cnt++;
+      frames[cnt++] = frame;
+    }
+    lock_release (&frame -> lk);
+  }
+  /* The order looks at the files, which may be closed once the
+     lock is released. */
+  qsort (frames, cnt, sizeof *frames, frame_file_order);
+  lock_release (&frame_list_lock);
+
+  for (i = 0; i < cnt; i++)
+  {
+    frame_writeback (frames[i]);
+    frame_unpin (frames[i]);
+  }
+  free (frames);
+}
+
+static int
+frame_file_order (const void *a_, const void *b_)
+{
+  const struct frame *a = *(struct frame * const *) a_;
+  const struct frame *b = *(struct frame * const *) b_;
+  struct inode *a_inode = file_get_inode (a -> file);
+  struct inode *b_inode = file_get_inode (b -> file);
+  if (a_inode != b_inode)
+    return a_inode < b_inode ? -1 : 1;
+  return a -> ofs < b -> ofs ? -1 : a -> ofs > b -> ofs;
+}
+
+/*
+ * Adds CNT to the resident page count of T. Other threads update it
+ * too, on eviction and swap in.
+ */
+static void
+frame_rss_add (struct thread *t, int cnt)
+{
+  lock_acquire (&t -> pagedir_lock);
+  t -> rss += cnt;
+  lock_release (&t -> pagedir_lock);
+}
@@ -24,6 +24,11 @@ struct frame
   struct  list_elem elem;   /* To maintain a list of frames. */ 
   struct  list user_list;   /* List of users using this frame. */
   bool    writable;         /* Whether the frame is writable. */
+  bool    cow;              /* Shared by forked processes until one
+                               of them stores to it. */
+  int     pin_cnt;          /* Not evicted while above 0, see vm_pin(). */
+  bool    released;         /* Dropped by its last user while pinned,
+                               frame_unpin() frees it. */
   struct  file *file;        /* If mapped, then to which file. */
   off_t   ofs;              /* Mapped to which offset in file. */
   int     magic;
@@ -34,6 +39,9 @@ struct frame
 struct user
 {
   tid_t   tid;              /* The process who installed the frame. */
+  struct  thread *thread;   /* Same process. It untracks its frames before
+                               exiting, so holding the frame's lock keeps
+                               it alive. */
   void    *vaddr;           /* The virtual address where the frame is installed. */
   struct  list_elem elem;   /* List elem to create a list. */
 };
@@ -55,9 +63,14 @@ void frame_init (void);
 struct frame * frame_create (void *addr);
 struct frame * frame_alloc (enum palloc_flags );
 struct frame * frame_alloc_lockless (enum palloc_flags );
+struct frame * frame_try_alloc (enum palloc_flags );
 bool frame_dealloc (struct frame *frame, void *vaddr);
 void frame_track (struct frame *, void *);
 void frame_untrack (struct frame * frame, void *vaddr);
 bool frame_in (struct frame *f);
 bool frame_is_dirty (struct frame *frame);
+void frame_unpin (struct frame *frame);
+bool frame_writeback (struct frame *frame);
+void frame_writeback_sorted (struct frame **frames, size_t cnt);
+void frame_writeback_all (void);
 #endif
@@ -12,9 +12,24 @@
 #include "vm/frame.h"
 #include "userprog/syscall.h"
 #include "vm/sframe.h"
+#include "vm/region.h"
+#include "devices/timer.h"
+#include "filesys/bcache.h"
+#include "filesys/inode.h"
+#include <round.h>
+#include "threads/thread.h"
+
+/* Ticks between two runs of the mmap writer. */
+#define MMAP_WRITEBACK_TICKS 1000
+
+/* Most bytes MADV_WILLNEED reads ahead per region, half of the
+   buffer cache. */
+#define MMAP_WILLNEED_MAX (BUFFER_CACHE_SIZE / 2 * BLOCK_SECTOR_SIZE)
 
 static mapid_t give_unique_mapid (void);
 static struct mapped_entry * find_mapped_entry (mapid_t id);
+static void mmap_writer_thread (void *aux UNUSED);
+static void mmap_region_sync (struct region *region);
 
 /*
  * This function is used to provide a unique id to each mmaped file
@@ -52,37 +67,26 @@ mapid_t vm_mmap (struct file *file, void *vaddr)
   if (size % PGSIZE != 0)
     pages_required++;
 
+  if (size == 0 || !is_user_vaddr (vaddr)
+      || (uintptr_t) PHYS_BASE - (uintptr_t) vaddr
+         < (uintptr_t) pages_required * PGSIZE
+      || region_overlaps (vaddr, pages_required))
+    goto done;
+
   struct mapped_entry *new_entry;
   new_entry = malloc (sizeof (struct mapped_entry));
   if (!new_entry)
     goto done;
 
-  struct sup_page_table_entry *new_page_table_entry = NULL;
-  int iterator = 0;
-
-  while (iterator < pages_required)
+  /* The pages are set up lazily, on the first fault, from the
+     region. */
+  if (region_create (vaddr, pages_required, file, 0, size, true, true) == NULL)
   {
-    if (find_page_by_vaddr (vaddr + iterator*PGSIZE) != NULL)
-      goto done;
-    iterator++;
+    free (new_entry);
+    goto done;
   }
-  iterator = 0;
   result = give_unique_mapid ();
   new_entry -> vaddr = vaddr;
-  while (iterator < pages_required)
-  {
-    new_page_table_entry = vm_page_create (vaddr);
-    new_page_table_entry -> file_mapped = true;
-    new_page_table_entry -> frame = NULL;
-    new_page_table_entry -> file = file;
-    new_page_table_entry -> offset = PGSIZE * iterator;
-    new_page_table_entry -> page_read_bytes = PGSIZE;
-    new_page_table_entry -> writable = true;
-    new_page_table_entry -> shared = false;//true;
-    vaddr = vaddr + PGSIZE;
-    iterator++;
-  }
-  new_page_table_entry -> page_read_bytes = size % PGSIZE == 0 ? PGSIZE : size % PGSIZE;
   new_entry -> id = result;
   new_entry -> file = file;
   list_push_back (thread_current () -> mapping, &new_entry -> list_elem);
@@ -102,25 +106,176 @@ void vm_unmap (mapid_t id)
   if (!new_entry)
     return;
 
-  int size = file_length(new_entry -> file);
-  int iterator = 0;
-
-  int pages_mapped = size/PGSIZE;
-  if (size % PGSIZE != 0)
-    pages_mapped++;
-  struct sup_page_table_entry * pte = NULL;
-  while (iterator < pages_mapped)
-  {
-    pte = find_page_by_vaddr (new_entry -> vaddr + iterator*PGSIZE);
-    ASSERT (pte != NULL);
-    vm_page_remove (pte);
-    iterator ++;
-  }
+  struct region *region = region_find (new_entry -> vaddr);
+  ASSERT (region != NULL && region -> file_mapped);
+  region_remove (region);
   list_remove (&new_entry -> list_elem);
   file_close (new_entry -> file);
   free (new_entry);
 }
 
+/*
+ * Writes back the pages of mapping ID which were dirtied since they
+ * were last written, in file order, and keeps the mapping.
+ */
+void vm_msync (mapid_t id)
+{
+  struct mapped_entry *entry = find_mapped_entry (id);
+  if (!entry)
+    return;
+  struct region *region = region_find (entry -> vaddr);
+  ASSERT (region != NULL && region -> file_mapped);
+  mmap_region_sync (region);
+}
+
+/*
+ * Writes back the dirty pages of REGION, a mmap, in file order.
+ */
+static void mmap_region_sync (struct region *region)
+{
+  /* Only pages which were touched can be dirty. */
+  struct frame **frames = malloc (list_size (&region -> pages) * sizeof *frames);
+  if (frames == NULL)
+    return;
+  size_t cnt = 0;
+  struct list_elem *e;
+  for (e = list_begin (&region -> pages); e != list_end (&region -> pages);
+       e = list_next (e))
+  {
+    struct sup_page_table_entry *pte = list_entry (e, struct sup_page_table_entry,
+                                                   region_elem);
+    if (pte -> frame != NULL)
+      frames[cnt++] = pte -> frame;
+  }
+  frame_writeback_sorted (frames, cnt);
+  free (frames);
+}
+
+/*
+ * Copies the mappings of PARENT, which waits in fork, to the current
+ * thread. Each copy keeps its mapid and gets a handle of its own on
+ * the file. The copies read their pages from the file, so the dirty
+ * pages of PARENT are written back first.
+ */
+bool vm_mmap_fork (struct thread *parent)
+{
+  struct list_elem *e;
+  for (e = list_begin (parent -> mapping); e != list_end (parent -> mapping);
+       e = list_next (e))
+  {
+    struct mapped_entry *entry = list_entry (e, struct mapped_entry, list_elem);
+    struct region *region = region_lookup (parent, entry -> vaddr);
+    ASSERT (region != NULL && region -> file_mapped);
+    mmap_region_sync (region);
+
+    struct mapped_entry *new_entry = malloc (sizeof (struct mapped_entry));
+    if (!new_entry)
+      return false;
+    new_entry -> file = file_reopen (entry -> file);
+    if (new_entry -> file == NULL || region_copy (region, new_entry -> file) == NULL)
+    {
+      file_close (new_entry -> file);
+      free (new_entry);
+      return false;
+    }
+    new_entry -> vaddr = entry -> vaddr;
+    new_entry -> id = entry -> id;
+    list_push_back (thread_current () -> mapping, &new_entry -> list_elem);
+  }
+  return true;
+}
+
+/*
+ * Applies the MADV_* hint ADVICE to the LENGTH bytes at ADDR, which
+ * must be page aligned. Hints on how a range is accessed are kept per
+ * region. Returns false if the range or the hint is bad.
+ */
+bool vm_madvise (void *addr, size_t length, int advice)
+{
+  struct list *regions = thread_current () -> regions;
+  uint8_t *start = addr;
+  uint8_t *end;
+  struct list_elem *e;
+  if (pg_ofs (addr) != 0 || !is_user_vaddr (addr)
+      || (size_t) ((uint8_t *) PHYS_BASE - start) < length || regions == NULL)
+    return false;
+  end = start + ROUND_UP (length, PGSIZE);
+
+  switch (advice)
+  {
+    case MADV_NORMAL:
+    case MADV_RANDOM:
+    case MADV_SEQUENTIAL:
+      for (e = list_begin (regions); e != list_end (regions); e = list_next (e))
+      {
+        struct region *region = list_entry (e, struct region, elem);
+        if ((uint8_t *) region -> start >= end)
+          break;
+        if ((uint8_t *) region -> end > start)
+          region -> advice = advice;
+      }
+      return true;
+    case MADV_WILLNEED:
+      /* Have the readahead thread pull the file data into the
+         buffer cache, the faults then do not wait for the disk. */
+      for (e = list_begin (regions); e != list_end (regions); e = list_next (e))
+      {
+        struct region *region = list_entry (e, struct region, elem);
+        if ((uint8_t *) region -> start >= end)
+          break;
+        if ((uint8_t *) region -> end <= start)
+          continue;
+        uint32_t first = start > (uint8_t *) region -> start ?
+                         start - (uint8_t *) region -> start : 0;
+        uint32_t last = end < (uint8_t *) region -> end ?
+                        end - (uint8_t *) region -> start
+                        : (uint8_t *) region -> end - (uint8_t *) region -> start;
+        if (last > region -> read_bytes)
+          last = region -> read_bytes;
+        if (last > first + MMAP_WILLNEED_MAX)
+          last = first + MMAP_WILLNEED_MAX;
+        if (first < last)
+          inode_readahead (file_get_inode (region -> file),
+                           region -> offset + first, last - first);
+      }
+      return true;
+    case MADV_DONTNEED:
+      /* Superpages have no entries of their own to unload. */
+      if (!region_discard_superpages (start, end))
+        return false;
+      for (; start < end; start += PGSIZE)
+      {
+        struct sup_page_table_entry *pte = find_page_by_vaddr (start);
+        if (pte != NULL)
+          sup_page_table_unload (pte);
+      }
+      return true;
+    case MADV_HUGEPAGE:
+    case MADV_NOHUGEPAGE:
+      region_allow_superpages (start, end, advice == MADV_HUGEPAGE);
+      return true;
+    default:
+      return false;
+  }
+}
+
+/*
+ * Starts the thread which periodically writes back dirty mmap pages.
+ */
+void vm_mmap_writer_init (void)
+{
+  thread_create ("Mmap_writer", PRI_DEFAULT, mmap_writer_thread, NULL);
+}
+
+static void mmap_writer_thread (void *aux UNUSED)
+{
+  while (true)
+  {
+    timer_sleep (MMAP_WRITEBACK_TICKS);
+    frame_writeback_all ();
+  }
+}
+
 /*
  * Returns mapped_entry struct corresponding to mapid_t ID
  */
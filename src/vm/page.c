@@ -1,7 +1,10 @@
 #include "vm/vm.h"
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "vm/frame.h"
 #include "vm/sframe.h"
+#include "vm/region.h"
+#include "vm/trace.h"
 #include "lib/string.h"
 
 unsigned sup_hash_func (const struct hash_elem *, void * UNUSED);
@@ -10,6 +13,45 @@ bool sup_less_func (const struct hash_elem *,
                       void * UNUSED);
 struct sup_page_table_entry * hash_lookup (const void *);
 static struct frame * sup_page_table_fill_new_frame (struct sup_page_table_entry *sp_entry);
+static bool sup_page_table_is_zero_fill (struct sup_page_table_entry *spt_entry);
+static struct frame * sup_page_table_fill_frame (struct sup_page_table_entry *spt_entry,
+                                                 struct frame *frame);
+static void sup_page_table_fault_around (struct sup_page_table_entry *spt_entry);
+static void sup_page_table_drop_behind (struct sup_page_table_entry *spt_entry);
+static bool sup_page_table_cow_copy (struct sup_page_table_entry *spt_entry);
+static bool sup_page_table_load_ (struct sup_page_table_entry *spt_entry,
+                                  bool write);
+static int sup_page_table_fault_type (struct sup_page_table_entry *spt_entry,
+                                      bool write);
+static struct frame *sup_page_table_frame (struct sup_page_table_entry *spt_entry);
+static bool vm_pin_page (void *page, bool write);
+static bool sup_page_table_fork_page (struct thread *parent,
+                                      struct sup_page_table_entry *src);
+static void sup_pt_index_insert (struct thread *t,
+                                 struct sup_page_table_entry *spt_entry);
+static void sup_pt_index_remove (struct thread *t,
+                                 struct sup_page_table_entry *spt_entry);
+static void sup_pt_index_destroy (struct thread *t);
+
+/* Number of slots in the directory of the radix index, one per
+   page table worth (4 MB) of user virtual memory. */
+#define SUP_PT_INDEX_CNT ((uintptr_t) PHYS_BASE >> PDSHIFT)
+
+/* Fault-around window, in pages. It starts at FAULT_AROUND_MIN and
+   doubles on every fault that lands right after the last window. */
+#define FAULT_AROUND_MIN 1
+#define FAULT_AROUND_MAX 16
+
+/* Statistics. */
+static long long zero_map_cnt;    /* # of reads served by the zero frame. */
+static long long zero_cow_cnt;    /* # of stores that broke the sharing. */
+static long long fault_around_cnt;  /* # of pages mapped ahead of a fault. */
+static long long shared_hit_cnt;  /* # of faults served by a shared frame. */
+static long long cow_break_cnt;   /* # of stores to shared data pages. */
+static long long drop_behind_cnt; /* # of pages dropped behind a sequential reader. */
+static long long fork_share_cnt;  /* # of private pages shared by fork. */
+static long long fork_copy_cnt;   /* # of stores that copied a forked page. */
+static long long fork_reuse_cnt;  /* # of stores by the last user of a forked page. */
 
 
 /*
@@ -46,12 +88,14 @@ void sup_pt_init (void)
   process = thread_current();//get_thread (tid);
   process-> sup_pt = (struct hash *)malloc (sizeof (struct hash));
   hash_init (process -> sup_pt, sup_hash_func, sup_less_func, NULL);
+  process -> sup_pt_index = palloc_get_page (PAL_ZERO);
   lock_init (&process -> pt_lock);
 }
 
 /*
  * Create a entry in sup_page table entry for VADDR
  * DO NOT allocate frame right now, we are looking for lazy loading.
+ * Returns NULL if VADDR already has an entry.
  */
 struct sup_page_table_entry *vm_page_create (void *vaddr)
 {
@@ -70,7 +114,18 @@ struct sup_page_table_entry *vm_page_create (void *vaddr)
   result -> offset = 0;
   result -> file = NULL;
   result -> page_read_bytes = 0;
-  hash_insert (process -> sup_pt, &result -> hash_elem);
+  result -> writable = true;
+  result -> shared = false;
+  result -> zero_mapped = false;
+  result -> cow = false;
+  result -> region = NULL;
+  if (hash_insert (process -> sup_pt, &result -> hash_elem) == NULL)
+    sup_pt_index_insert (process, result);
+  else
+  {
+    free (result);
+    result = NULL;
+  }
   done:
     lock_release (&process -> pt_lock);
     return result;
@@ -98,9 +153,13 @@ struct sup_page_table_entry *vm_create_page_and_alloc (void *vaddr)
   result -> page_read_bytes = 0;
   result -> frame = NULL;
   result -> shared = false;
+  result -> zero_mapped = false;
+  result -> cow = false;
+  result -> region = NULL;
   result -> file = NULL;
   hash_insert (process -> sup_pt, &result -> hash_elem);
-  sup_page_table_load (result);
+  sup_pt_index_insert (process, result);
+  sup_page_table_load (result, true);
   done:
     return result;
 }
@@ -111,27 +170,295 @@ struct sup_page_table_entry *vm_create_page_and_alloc (void *vaddr)
  */
 struct sup_page_table_entry * find_page_by_vaddr (void *vaddr)
 {
-  
-  struct sup_page_table_entry *temp;
-  temp = (struct sup_page_table_entry *)malloc (
-          sizeof (struct sup_page_table_entry *));
   struct thread *process;
   process = thread_current();//get_thread (tid);
+  if (process -> sup_pt_index != NULL)
+  {
+    if (!is_user_vaddr (vaddr) || pg_ofs (vaddr) != 0)
+      return NULL;
+    struct sup_page_table_entry **table = process -> sup_pt_index[pd_no (vaddr)];
+    return table != NULL ? table[pt_no (vaddr)] : NULL;
+  }
+
+  /* Only the key of the entry is looked at. */
+  struct sup_page_table_entry temp;
   struct hash_elem * elem;
-  temp -> vaddr = (void *) vaddr;
-  elem = hash_find (process -> sup_pt, &temp -> hash_elem);
-  free (temp);
+  temp.vaddr = (void *) vaddr;
+  elem = hash_find (process -> sup_pt, &temp.hash_elem);
   if (!elem)
     return NULL;
   
   return hash_entry (elem, struct sup_page_table_entry, hash_elem);
 }
 
+/*
+ * Returns the entry for VADDR like find_page_by_vaddr(), creating it
+ * from the region containing VADDR on the first touch.
+ */
+struct sup_page_table_entry *
+vm_page_get (void *vaddr)
+{
+  struct sup_page_table_entry *spt_entry = find_page_by_vaddr (vaddr);
+  if (spt_entry == NULL)
+  {
+    struct region *region = region_find (vaddr);
+    if (region != NULL)
+      spt_entry = region_page_create (region, vaddr);
+  }
+  return spt_entry;
+}
+
+/*
+ * Faults in the pages holding the LENGTH bytes at UADDR, writable if
+ * WRITE, and pins their frames so that the clock leaves them alone
+ * until vm_unpin(). The kernel can then access the range without
+ * faulting. Returns false, with nothing pinned, if part of the range
+ * is not valid user memory.
+ */
 bool
-sup_page_table_load (struct sup_page_table_entry *spt_entry)
+vm_pin (const void *uaddr, size_t length, bool write)
+{
+  uint8_t *start = pg_round_down (uaddr);
+  uint8_t *end = (uint8_t *) uaddr + length;
+  uint8_t *page;
+  if (length == 0)
+    return true;
+  if (end < (uint8_t *) uaddr || !is_user_vaddr (end - 1))
+    return false;
+  for (page = start; page < end; page += PGSIZE)
+    if (!vm_pin_page (page, write))
+    {
+      if (page != start)
+        vm_unpin (start, page - start);
+      return false;
+    }
+  return true;
+}
+
+/*
+ * Unpins the pages pinned by vm_pin() for the same range.
+ */
+void
+vm_unpin (const void *uaddr, size_t length)
+{
+  uint8_t *end = (uint8_t *) uaddr + length;
+  uint8_t *page;
+  for (page = pg_round_down (uaddr); page < end; page += PGSIZE)
+  {
+    struct sup_page_table_entry *spt_entry = find_page_by_vaddr (page);
+    struct frame *frame = spt_entry != NULL ? sup_page_table_frame (spt_entry)
+                                            : NULL;
+    if (frame == NULL)
+      continue;
+    frame_unpin (frame);
+  }
+}
+
+/*
+ * Brings PAGE in, like a fault would, and pins its frame. Pages
+ * mapped to the zero frame for a read and superpages need no pin,
+ * they are never evicted.
+ */
+static bool
+vm_pin_page (void *page, bool write)
+{
+  struct thread *t = thread_current ();
+  struct sup_page_table_entry *spt_entry = find_page_by_vaddr (page);
+  if (spt_entry == NULL)
+  {
+    if (pagedir_get_page (t -> pagedir, page) != NULL
+        || region_map_superpage (page))
+      return true;
+    spt_entry = vm_page_get (page);
+    /* A buffer in the stack may lie in pages the stack grows into. */
+    if (spt_entry == NULL
+        && (uint8_t *) page + PGSIZE > (uint8_t *) t -> esp - 32
+        && (uint8_t *) page >= (uint8_t *) PHYS_BASE - STACK_MAX_PAGES * PGSIZE)
+      spt_entry = vm_page_create (page);
+    if (spt_entry == NULL)
+      return false;
+  }
+  if (write && !spt_entry -> writable && !spt_entry -> cow)
+    return false;
+
+  for (;;)
+  {
+    struct frame *frame = sup_page_table_frame (spt_entry);
+    if (frame == NULL || (write && spt_entry -> cow))
+    {
+      if (!sup_page_table_load (spt_entry, write))
+        return false;
+      if (spt_entry -> zero_mapped)
+        return true;
+      continue;
+    }
+    lock_acquire (&frame -> lk);
+    if (!frame -> in_swap)
+    {
+      frame -> pin_cnt++;
+      lock_release (&frame -> lk);
+      return true;
+    }
+    lock_release (&frame -> lk);
+    if (!frame_in (frame))
+      return false;
+  }
+}
+
+/*
+ * Returns the frame backing SPT_ENTRY, or NULL if it has none.
+ */
+static struct frame *
+sup_page_table_frame (struct sup_page_table_entry *spt_entry)
+{
+  if (spt_entry -> frame == NULL)
+    return NULL;
+  if (!spt_entry -> shared)
+    return spt_entry -> frame;
+  struct sframe *sframe = (struct sframe *) spt_entry -> frame;
+  return spt_entry -> file_mapped ? sframe -> mmapped_frame : sframe -> frame;
+}
+
+/*
+ * Records SPT_ENTRY in the radix index of T. The index is a
+ * directory of page tables sized like the hardware ones, which makes
+ * a lookup two loads. It must cover every entry of the hash, so if a
+ * page table can not be allocated it is dropped and lookups go back
+ * to the hash.
+ */
+static void
+sup_pt_index_insert (struct thread *t, struct sup_page_table_entry *spt_entry)
+{
+  if (t -> sup_pt_index == NULL)
+    return;
+  ASSERT (is_user_vaddr (spt_entry -> vaddr));
+  struct sup_page_table_entry ***pde = &t -> sup_pt_index[pd_no (spt_entry -> vaddr)];
+  if (*pde == NULL)
+  {
+    *pde = palloc_get_page (PAL_ZERO);
+    if (*pde == NULL)
+    {
+      sup_pt_index_destroy (t);
+      return;
+    }
+  }
+  (*pde)[pt_no (spt_entry -> vaddr)] = spt_entry;
+}
+
+static void
+sup_pt_index_remove (struct thread *t, struct sup_page_table_entry *spt_entry)
+{
+  if (t -> sup_pt_index == NULL)
+    return;
+  struct sup_page_table_entry **table = t -> sup_pt_index[pd_no (spt_entry -> vaddr)];
+  if (table != NULL && table[pt_no (spt_entry -> vaddr)] == spt_entry)
+    table[pt_no (spt_entry -> vaddr)] = NULL;
+}
+
+static void
+sup_pt_index_destroy (struct thread *t)
+{
+  size_t i;
+  if (t -> sup_pt_index == NULL)
+    return;
+  for (i = 0; i < SUP_PT_INDEX_CNT; i++)
+    if (t -> sup_pt_index[i] != NULL)
+      palloc_free_page (t -> sup_pt_index[i]);
+  palloc_free_page (t -> sup_pt_index);
+  t -> sup_pt_index = NULL;
+}
+
+/*
+ * Brings the page SPT_ENTRY in. WRITE tells whether the faulting access
+ * was a store. Pages that would only be zero filled are mapped read-only
+ * to the shared zero frame on a load and get a frame of their own on
+ * the first store. The fault is timed and traced, see vm/trace.c.
+ */
+bool
+sup_page_table_load (struct sup_page_table_entry *spt_entry, bool write)
+{
+  ASSERT (spt_entry != NULL);
+  int type = sup_page_table_fault_type (spt_entry, write);
+  thread_current () -> fault_victim = NULL;
+  uint64_t start = rdtsc ();
+  bool success = sup_page_table_load_ (spt_entry, write);
+  vm_trace_record (spt_entry -> vaddr, type, rdtsc () - start);
+  return success;
+}
+
+/*
+ * Returns the VM_FAULT_* type of a fault on SPT_ENTRY, before it is
+ * served.
+ */
+static int
+sup_page_table_fault_type (struct sup_page_table_entry *spt_entry, bool write)
+{
+  struct frame *frame = spt_entry -> frame;
+  if (spt_entry -> zero_mapped)
+    return VM_FAULT_ZERO;
+  if (write && spt_entry -> cow)
+    return VM_FAULT_COW;
+  if (spt_entry -> shared)
+    return VM_FAULT_SHARED;
+  if (frame != NULL)
+  {
+    switch (get_frame_loc (frame))
+    {
+      case SWAP:
+        return VM_FAULT_SWAP;
+      case FILE_SYS:
+        return VM_FAULT_FILE;
+      default:
+        return VM_FAULT_MINOR;
+    }
+  }
+  /* Only the stack has pages outside of regions. */
+  if (spt_entry -> region == NULL)
+    return VM_FAULT_STACK;
+  if (spt_entry -> file != NULL && spt_entry -> page_read_bytes != 0)
+    return VM_FAULT_FILE;
+  return VM_FAULT_ZERO;
+}
+
+static bool
+sup_page_table_load_ (struct sup_page_table_entry *spt_entry, bool write)
 {
   bool success = false;
   ASSERT (spt_entry != NULL);
+  if (spt_entry -> zero_mapped)
+  {
+    if (!write)
+      return true;
+    pagedir_clear_page (thread_current () -> pagedir, spt_entry -> vaddr);
+    spt_entry -> zero_mapped = false;
+    zero_cow_cnt++;
+  }
+  else if (write && spt_entry -> cow && !spt_entry -> shared
+           && spt_entry -> frame != NULL)
+    return sup_page_table_cow_copy (spt_entry);
+  else if (write && spt_entry -> cow)
+  {
+    /* First store to a data page shared with other processes. Since
+       shared frames are never written to, the file still holds the
+       contents, so drop the share and load a private copy. */
+    if (spt_entry -> frame != NULL)
+      sframe_remove ((struct sframe *) spt_entry -> frame, spt_entry);
+    spt_entry -> frame = NULL;
+    spt_entry -> shared = false;
+    spt_entry -> cow = false;
+    spt_entry -> writable = true;
+    cow_break_cnt++;
+  }
+  else if (!write && sup_page_table_is_zero_fill (spt_entry))
+  {
+    success = pagedir_set_page (thread_current () -> pagedir,
+                                spt_entry -> vaddr, zero_page, false);
+    spt_entry -> zero_mapped = success;
+    if (success)
+      zero_map_cnt++;
+    return success;
+  }
+
   if (spt_entry -> frame)
   {
     struct frame *frame = NULL;
@@ -158,6 +485,8 @@ sup_page_table_load (struct sup_page_table_entry *spt_entry)
     {
       spt_entry -> frame = (void *) frame;
       success = true;
+      if (spt_entry -> file != NULL && spt_entry -> page_read_bytes != 0)
+        sup_page_table_fault_around (spt_entry);
       goto done;
     }
     success = false;
@@ -172,7 +501,11 @@ sup_page_table_load (struct sup_page_table_entry *spt_entry)
       *frame = sup_page_table_fill_new_frame (spt_entry);
       success = (*frame != NULL);
       if (success)
+      {
         spt_entry -> frame = (void *) sframe;
+        if (sframe -> file != NULL)
+          (*frame) -> file = sframe -> file;
+      }
       lock_release (&sframe -> lk);
       goto done;
     }
@@ -187,6 +520,7 @@ sup_page_table_load (struct sup_page_table_entry *spt_entry)
       lock_release (&(*frame) -> lk);
       lock_release (&sframe -> lk);
       success = frame_in (*frame);
+      shared_hit_cnt++;
       goto done;
     }
   }
@@ -194,12 +528,84 @@ sup_page_table_load (struct sup_page_table_entry *spt_entry)
   return success;
 }
 
+/*
+ * Returns true if SPT_ENTRY has no contents yet, other than zeros.
+ */
+static bool
+sup_page_table_is_zero_fill (struct sup_page_table_entry *spt_entry)
+{
+  return spt_entry -> frame == NULL && !spt_entry -> shared
+         && (spt_entry -> file == NULL || spt_entry -> page_read_bytes == 0);
+}
+
 static struct frame *
 sup_page_table_fill_new_frame (struct sup_page_table_entry *spt_entry)
 {
   struct frame *frame = frame_alloc (PAL_USER);
   if (!frame)
     return NULL;
+  return sup_page_table_fill_frame (spt_entry, frame);
+}
+
+/*
+ * Maps the file-backed pages following SPT_ENTRY, which has just been
+ * loaded, as long as they come from the same file and free frames are
+ * at hand. Their reads hit the sectors the buffer cache has just read
+ * ahead. Prefaulted pages are not marked accessed, so the clock takes
+ * them back first if they are never used.
+ */
+static void
+sup_page_table_fault_around (struct sup_page_table_entry *spt_entry)
+{
+  struct thread *t = thread_current ();
+  int advice = spt_entry -> region != NULL ? spt_entry -> region -> advice
+                                           : MADV_NORMAL;
+  if (advice == MADV_RANDOM)
+    return;
+  if (advice == MADV_SEQUENTIAL)
+  {
+    t -> fault_around_window = FAULT_AROUND_MAX;
+    sup_page_table_drop_behind (spt_entry);
+  }
+  else if (spt_entry -> vaddr == t -> fault_around_next)
+    t -> fault_around_window = t -> fault_around_window * 2 > FAULT_AROUND_MAX ?
+                               FAULT_AROUND_MAX : t -> fault_around_window * 2;
+  else
+    t -> fault_around_window = FAULT_AROUND_MIN;
+
+  void *vaddr = spt_entry -> vaddr + PGSIZE;
+  int i;
+  for (i = 0; i < t -> fault_around_window && is_user_vaddr (vaddr); i++)
+  {
+    struct sup_page_table_entry *next = vm_page_get (vaddr);
+    if (next == NULL || next -> file != spt_entry -> file
+        || next -> frame != NULL || next -> zero_mapped || next -> shared
+        || next -> page_read_bytes == 0)
+      break;
+    /* Read ahead only within the resident limit. */
+    if (t -> rss_limit != 0 && t -> rss >= t -> rss_limit)
+      break;
+    struct frame *frame = frame_try_alloc (PAL_USER);
+    if (frame == NULL)
+      break;
+    frame = sup_page_table_fill_frame (next, frame);
+    if (frame == NULL)
+      break;
+    next -> frame = frame;
+    fault_around_cnt++;
+    vaddr += PGSIZE;
+  }
+  t -> fault_around_next = vaddr;
+}
+
+/*
+ * Fills FRAME, which is locked, with the contents of SPT_ENTRY and maps
+ * it. Returns the frame unlocked, or NULL on failure.
+ */
+static struct frame *
+sup_page_table_fill_frame (struct sup_page_table_entry *spt_entry,
+                           struct frame *frame)
+{
   uint32_t bytes = 0;
   if (spt_entry -> file != NULL)
   {
@@ -247,6 +653,9 @@ static void
 vm_page_remove_ (struct hash_elem *e, void *aux UNUSED)
 {
     struct sup_page_table_entry *sp_entry = hash_entry (e, struct sup_page_table_entry, hash_elem);
+    /* The zero frame is not ours, pagedir_destroy must not free it. */
+    if (sp_entry -> zero_mapped)
+      pagedir_clear_page (thread_current () -> pagedir, sp_entry -> vaddr);
     if (sp_entry -> frame != NULL)
     {
       if (sp_entry -> shared)
@@ -255,8 +664,8 @@ vm_page_remove_ (struct hash_elem *e, void *aux UNUSED)
       }
       else
       {
-        bool killed = frame_dealloc (sp_entry -> frame, sp_entry -> vaddr);
-        ASSERT(killed);
+        /* A frame shared with forked processes stays theirs. */
+        frame_dealloc (sp_entry -> frame, sp_entry -> vaddr);
       }
     }
     free (sp_entry);
@@ -266,6 +675,9 @@ void
 vm_page_remove (struct sup_page_table_entry *sup_pt)
 {
   hash_delete (thread_current () -> sup_pt, &sup_pt -> hash_elem);
+  sup_pt_index_remove (thread_current (), sup_pt);
+  if (sup_pt -> region != NULL)
+    list_remove (&sup_pt -> region_elem);
   vm_page_remove_ (&sup_pt -> hash_elem, NULL);
 }
 
@@ -276,5 +688,230 @@ vm_page_remove (struct sup_page_table_entry *sup_pt)
 void
 sup_page_table_destroy (struct hash *sp_pd)
 {
+  sup_pt_index_destroy (thread_current ());
   hash_destroy (sp_pd, vm_page_remove_);
 }
+
+/*
+ * Drops the window of pages which lies FAULT_AROUND_MAX pages behind
+ * SPT_ENTRY, a page of a mmap read sequentially, so the reader does
+ * not push out other pages. Dirty pages are written back.
+ */
+static void
+sup_page_table_drop_behind (struct sup_page_table_entry *spt_entry)
+{
+  struct region *region = spt_entry -> region;
+  if (region == NULL || !region -> file_mapped)
+    return;
+  uint8_t *end = (uint8_t *) spt_entry -> vaddr - FAULT_AROUND_MAX * PGSIZE;
+  uint8_t *vaddr = end - FAULT_AROUND_MAX * PGSIZE;
+  if (end <= (uint8_t *) region -> start)
+    return;
+  if (vaddr < (uint8_t *) region -> start)
+    vaddr = region -> start;
+  for (; vaddr < end; vaddr += PGSIZE)
+  {
+    struct sup_page_table_entry *behind = find_page_by_vaddr (vaddr);
+    if (behind != NULL && behind -> frame != NULL)
+    {
+      sup_page_table_unload (behind);
+      drop_behind_cnt++;
+    }
+  }
+}
+
+/*
+ * Gives up the frame of SPT_ENTRY, keeping the entry. The page is
+ * read again from its file, or zeroed, on the next fault. Anonymous
+ * pages are dropped without being written anywhere, dirty mmap pages
+ * are written back to their file.
+ */
+void
+sup_page_table_unload (struct sup_page_table_entry *spt_entry)
+{
+  if (spt_entry -> zero_mapped)
+  {
+    pagedir_clear_page (thread_current () -> pagedir, spt_entry -> vaddr);
+    spt_entry -> zero_mapped = false;
+  }
+  else if (spt_entry -> frame != NULL)
+  {
+    if (spt_entry -> shared)
+      sframe_remove ((struct sframe *) spt_entry -> frame, spt_entry);
+    else
+    {
+      /* A frame shared with forked processes stays theirs, the page
+         is ours to write again once it is set up anew. */
+      frame_dealloc (spt_entry -> frame, spt_entry -> vaddr);
+      if (spt_entry -> cow)
+      {
+        spt_entry -> cow = false;
+        spt_entry -> writable = true;
+      }
+    }
+    spt_entry -> frame = NULL;
+  }
+}
+
+/*
+ * Gives SPT_ENTRY, a private page shared copy-on-write since a fork,
+ * a frame of its own on the first store to it. The last process left
+ * using the frame keeps it and only has it made writable.
+ */
+static bool
+sup_page_table_cow_copy (struct sup_page_table_entry *spt_entry)
+{
+  struct thread *t = thread_current ();
+  struct frame *frame = spt_entry -> frame;
+  void *copy;
+
+  /* The frame may be evicted again before it is locked. */
+  for (;;)
+  {
+    if (!frame_in (frame))
+      return false;
+    lock_acquire (&frame -> lk);
+    if (list_size (&frame -> user_list) == 1)
+    {
+      frame -> cow = false;
+      spt_entry -> cow = false;
+      spt_entry -> writable = true;
+      lock_acquire (&t -> pagedir_lock);
+      pagedir_set_writable (t -> pagedir, spt_entry -> vaddr, true);
+      lock_release (&t -> pagedir_lock);
+      lock_release (&frame -> lk);
+      fork_reuse_cnt++;
+      return true;
+    }
+    if (!frame -> in_swap)
+      break;
+    lock_release (&frame -> lk);
+  }
+
+  /* Allocating the new frame may evict, which locks frames, so the
+     contents go through a kernel page and the old frame is let go
+     of first. */
+  copy = palloc_get_page (0);
+  if (copy != NULL)
+    memcpy (copy, ptov ((uintptr_t) frame -> addr), PGSIZE);
+  lock_release (&frame -> lk);
+  if (copy == NULL)
+    return false;
+  frame_dealloc (frame, spt_entry -> vaddr);
+  spt_entry -> frame = NULL;
+  spt_entry -> cow = false;
+  spt_entry -> writable = true;
+
+  frame = frame_alloc (PAL_USER);
+  if (frame == NULL)
+  {
+    palloc_free_page (copy);
+    return false;
+  }
+  memcpy (ptov ((uintptr_t) frame -> addr), copy, PGSIZE);
+  palloc_free_page (copy);
+  frame -> untracked = false;
+  frame -> writable = true;
+  frame -> mmapped = false;
+  frame -> file = spt_entry -> file;
+  frame -> ofs = spt_entry -> offset;
+  frame -> read_bytes = spt_entry -> page_read_bytes;
+  if (!pagedir_set_page (t -> pagedir, spt_entry -> vaddr,
+                         ptov ((uintptr_t) frame -> addr), true))
+  {
+    frame -> untracked = true;
+    lock_release (&frame -> lk);
+    return false;
+  }
+  frame_track (frame, spt_entry -> vaddr);
+  lock_release (&frame -> lk);
+  spt_entry -> frame = frame;
+  fork_copy_cnt++;
+  return true;
+}
+
+/*
+ * Copies the pages of PARENT, which waits in fork, to the current
+ * thread, whose regions are copied already. Private frames are shared
+ * copy-on-write, the other pages are set up again from their region
+ * on the first fault like in PARENT.
+ */
+bool
+sup_page_table_fork (struct thread *parent)
+{
+  struct hash_iterator i;
+  hash_first (&i, parent -> sup_pt);
+  while (hash_next (&i))
+    if (!sup_page_table_fork_page (parent, hash_entry (hash_cur (&i),
+                                   struct sup_page_table_entry, hash_elem)))
+      return false;
+  return true;
+}
+
+static bool
+sup_page_table_fork_page (struct thread *parent,
+                          struct sup_page_table_entry *src)
+{
+  struct thread *t = thread_current ();
+  struct frame *frame = src -> frame;
+  struct sup_page_table_entry *dst;
+  /* Mmap pages are written back before the fork and are read again
+     from the file. */
+  bool private = frame != NULL && !src -> shared && !src -> file_mapped
+                 && (src -> writable || src -> cow);
+
+  if (src -> region != NULL)
+  {
+    if (!private)
+      return true;
+    dst = region_page_create (region_find (src -> vaddr), src -> vaddr);
+  }
+  else
+  {
+    /* Stack pages have no region to be set up from. */
+    dst = vm_page_create (src -> vaddr);
+    if (dst != NULL)
+      dst -> writable = src -> writable;
+  }
+  if (dst == NULL)
+    return false;
+  if (!private)
+    return true;
+
+  lock_acquire (&frame -> lk);
+  if (!frame -> in_swap
+      && !pagedir_set_page (t -> pagedir, dst -> vaddr,
+                            ptov ((uintptr_t) frame -> addr), false))
+  {
+    lock_release (&frame -> lk);
+    return false;
+  }
+  frame -> cow = true;
+  frame_track (frame, dst -> vaddr);
+  lock_acquire (&parent -> pagedir_lock);
+  if (parent -> pagedir != NULL)
+    pagedir_set_writable (parent -> pagedir, src -> vaddr, false);
+  lock_release (&parent -> pagedir_lock);
+  lock_release (&frame -> lk);
+
+  dst -> frame = frame;
+  dst -> shared = false;
+  dst -> cow = src -> cow = true;
+  dst -> writable = src -> writable = false;
+  fork_share_cnt++;
+  return true;
+}
+
+void
+page_print_stats (void)
+{
+  printf ("Zero page: %lld read mappings, %lld copy-on-write breaks\n",
+          zero_map_cnt, zero_cow_cnt);
+  printf ("Fault-around: %lld pages prefaulted\n", fault_around_cnt);
+  printf ("Shared pages: %lld faults served, %lld copy-on-write breaks\n",
+          shared_hit_cnt, cow_break_cnt);
+  printf ("Madvise: %lld pages dropped behind sequential readers\n",
+          drop_behind_cnt);
+  printf ("Fork: %lld pages shared, %lld copied on write, %lld reused\n",
+          fork_share_cnt, fork_copy_cnt, fork_reuse_cnt);
+}
@@ -0,0 +1,565 @@
+/* This file is for maintaining the regions of a process's address
+   space. Executable segments and mmaps are recorded as one region
+   each, so setting them up and tearing them down costs in the number
+   of regions and touched pages instead of the size of the mapping. */
+#include "vm/region.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/swap.h"
+#include "vm/vm.h"
+
+/* Superpages in use by all processes. They are never evicted, so
+   at most half the user pool goes to them. */
+static size_t superpage_cnt;
+static struct lock superpage_lock;
+
+/* Statistics. */
+static long long superpage_map_cnt;      /* # of superpages mapped. */
+static long long superpage_fallback_cnt; /* # of blocks left to 4 KB pages. */
+
+static struct superpage *region_superpage_find (struct region *,
+                                                void *vaddr);
+static void *region_superpage_alloc (void);
+static void *region_superpage_unmap (struct superpage *);
+static void region_superpage_free (struct superpage *);
+static bool region_copy_pages (uint8_t *upage, const uint8_t *kpage);
+static bool region_less (const struct list_elem *, const struct list_elem *,
+                         void *aux UNUSED);
+
+/*
+ * Initialize the accounting of superpages.
+ */
+void
+region_superpage_init (void)
+{
+  lock_init (&superpage_lock);
+}
+
+/*
+ * Initialize the region list of the current thread.
+ */
+void
+region_init (void)
+{
+  struct thread *t = thread_current ();
+  t -> regions = malloc (sizeof (struct list));
+  if (t -> regions != NULL)
+    list_init (t -> regions);
+}
+
+/*
+ * Records PAGE_CNT pages starting at START, the first READ_BYTES of
+ * which are read from FILE at OFFSET and the rest zeroed. No entry is
+ * created for the pages here, see region_page_create().
+ */
+struct region *
+region_create (void *start, size_t page_cnt, struct file *file, off_t offset,
+               uint32_t read_bytes, bool writable, bool file_mapped)
+{
+  struct thread *t = thread_current ();
+  ASSERT (pg_ofs (start) == 0);
+  ASSERT (read_bytes <= page_cnt * PGSIZE);
+  if (t -> regions == NULL)
+    return NULL;
+  struct region *region = malloc (sizeof (struct region));
+  if (region == NULL)
+    return NULL;
+  region -> start = start;
+  region -> end = (uint8_t *) start + page_cnt * PGSIZE;
+  region -> file = file;
+  region -> offset = offset;
+  region -> read_bytes = read_bytes;
+  region -> writable = writable;
+  region -> file_mapped = file_mapped;
+  region -> advice = MADV_NORMAL;
+  list_init (&region -> pages);
+  list_init (&region -> superpages);
+  list_insert_ordered (t -> regions, &region -> elem, region_less, NULL);
+  return region;
+}
+
+/*
+ * Returns the region of the current thread containing VADDR, or NULL.
+ */
+struct region *
+region_find (void *vaddr)
+{
+  return region_lookup (thread_current (), vaddr);
+}
+
+/*
+ * Returns the region of T containing VADDR, or NULL.
+ */
+struct region *
+region_lookup (struct thread *t, void *vaddr)
+{
+  struct list *regions = t -> regions;
+  struct list_elem *e;
+  if (regions == NULL)
+    return NULL;
+  for (e = list_begin (regions); e != list_end (regions); e = list_next (e))
+  {
+    struct region *region = list_entry (e, struct region, elem);
+    if (vaddr < region -> start)
+      break;
+    if (vaddr < region -> end)
+      return region;
+  }
+  return NULL;
+}
+
+/*
+ * Copies SRC, a region of another process, to the current thread with
+ * its pages read from FILE. Superpages are copied right away. If no
+ * superpage is free, only the 4 KB pages of the block holding data are
+ * copied, into pinned pages. The others are left to fault in as zeros,
+ * like the pages of a block never touched. Should be called with the
+ * current thread's page directory active. Returns NULL, with nothing
+ * left of the copy, on failure.
+ */
+struct region *
+region_copy (struct region *src, struct file *file)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+  struct region *dst = region_create (src -> start,
+                                      pg_no (src -> end) - pg_no (src -> start),
+                                      file, src -> offset, src -> read_bytes,
+                                      src -> writable, src -> file_mapped);
+  if (dst == NULL)
+    return NULL;
+  dst -> advice = src -> advice;
+  for (e = list_begin (&src -> superpages); e != list_end (&src -> superpages);
+       e = list_next (e))
+  {
+    struct superpage *from = list_entry (e, struct superpage, elem);
+    struct superpage *sp = malloc (sizeof (struct superpage));
+    if (sp == NULL)
+      goto fail;
+    sp -> upage = from -> upage;
+    sp -> kpage = NULL;
+    list_push_back (&dst -> superpages, &sp -> elem);
+    if (from -> kpage == NULL)
+      continue;
+    sp -> kpage = region_superpage_alloc ();
+    if (sp -> kpage != NULL
+        && pagedir_set_superpage (t -> pagedir, sp -> upage, sp -> kpage, true))
+    {
+      memcpy (sp -> kpage, from -> kpage, SUPERPAGE_SIZE);
+      superpage_map_cnt++;
+      lock_acquire (&t -> pagedir_lock);
+      t -> rss += SUPERPAGE_PAGES;
+      lock_release (&t -> pagedir_lock);
+    }
+    else
+    {
+      region_superpage_free (sp);
+      superpage_fallback_cnt++;
+      if (!region_copy_pages (sp -> upage, from -> kpage))
+        goto fail;
+    }
+  }
+  return dst;
+
+ fail:
+  region_remove (dst);
+  return NULL;
+}
+
+/*
+ * Copies the 4 KB pages of the superpage at KPAGE which are not all
+ * zeros to the block at UPAGE of the current thread, a page at a time.
+ */
+static bool
+region_copy_pages (uint8_t *upage, const uint8_t *kpage)
+{
+  size_t i;
+  for (i = 0; i < SUPERPAGE_PAGES; i++, upage += PGSIZE, kpage += PGSIZE)
+  {
+    if (page_is_zero (kpage))
+      continue;
+    if (!vm_pin (upage, PGSIZE, true))
+      return false;
+    memcpy (upage, kpage, PGSIZE);
+    vm_unpin (upage, PGSIZE);
+  }
+  return true;
+}
+
+/*
+ * Copies the regions of PARENT other than mmaps to the current
+ * thread, reading their pages from EXEC_FILE. See vm_mmap_fork() for
+ * the mmaps.
+ */
+bool
+region_fork (struct thread *parent, struct file *exec_file)
+{
+  struct list_elem *e;
+  if (parent -> regions == NULL)
+    return false;
+  for (e = list_begin (parent -> regions); e != list_end (parent -> regions);
+       e = list_next (e))
+  {
+    struct region *region = list_entry (e, struct region, elem);
+    if (!region -> file_mapped && region_copy (region, exec_file) == NULL)
+      return false;
+  }
+  return true;
+}
+
+/*
+ * Returns true if any of PAGE_CNT pages starting at START is in use.
+ * Apart from the regions only the stack has pages, so only the part
+ * of the range which the stack may grow into is checked page by page.
+ */
+bool
+region_overlaps (void *start, size_t page_cnt)
+{
+  struct list *regions = thread_current () -> regions;
+  uint8_t *end = (uint8_t *) start + page_cnt * PGSIZE;
+  uint8_t *stack = (uint8_t *) PHYS_BASE - STACK_MAX_PAGES * PGSIZE;
+  struct list_elem *e;
+  if (regions != NULL)
+    for (e = list_begin (regions); e != list_end (regions); e = list_next (e))
+    {
+      struct region *region = list_entry (e, struct region, elem);
+      if ((uint8_t *) region -> start >= end)
+        break;
+      if ((uint8_t *) region -> end > (uint8_t *) start)
+        return true;
+    }
+  uint8_t *page = (uint8_t *) start > stack ? (uint8_t *) start : stack;
+  for (; page < end; page += PGSIZE)
+    if (find_page_by_vaddr (page) != NULL)
+      return true;
+  return false;
+}
+
+/*
+ * Creates the supplemental page table entry for VADDR, a page of
+ * REGION which has none yet.
+ */
+struct sup_page_table_entry *
+region_page_create (struct region *region, void *vaddr)
+{
+  ASSERT (vaddr >= region -> start && vaddr < region -> end);
+  uint32_t ofs = (uint8_t *) vaddr - (uint8_t *) region -> start;
+  struct superpage *sp = region_superpage_find (region, vaddr);
+  if (sp != NULL && sp -> kpage != NULL)
+    return NULL;
+  struct sup_page_table_entry *pte = vm_page_create (vaddr);
+  if (pte == NULL)
+    return NULL;
+  pte -> file = region -> file;
+  pte -> offset = region -> offset + ofs;
+  if (region -> read_bytes <= ofs)
+    pte -> page_read_bytes = 0;
+  else if (region -> read_bytes - ofs < PGSIZE)
+    pte -> page_read_bytes = region -> read_bytes - ofs;
+  else
+    pte -> page_read_bytes = PGSIZE;
+  pte -> file_mapped = region -> file_mapped;
+  if (region -> file_mapped)
+    pte -> writable = region -> writable;
+  else
+  {
+    /* Pages backed by the file are shared between all processes
+       running the executable. Writable ones are mapped read-only
+       until the first store, which gives them a private copy. */
+    pte -> shared = pte -> page_read_bytes != 0;
+    pte -> cow = pte -> shared && region -> writable;
+    pte -> writable = region -> writable && !pte -> cow;
+  }
+  pte -> region = region;
+  list_push_back (&region -> pages, &pte -> region_elem);
+  return pte;
+}
+
+/*
+ * Removes REGION along with the pages created for it, writing the
+ * dirty ones back if it is a mmap.
+ */
+void
+region_remove (struct region *region)
+{
+  while (!list_empty (&region -> pages))
+    vm_page_remove (list_entry (list_front (&region -> pages),
+                                struct sup_page_table_entry, region_elem));
+  while (!list_empty (&region -> superpages))
+  {
+    struct superpage *sp = list_entry (list_pop_front (&region -> superpages),
+                                       struct superpage, elem);
+    region_superpage_free (sp);
+    free (sp);
+  }
+  list_remove (&region -> elem);
+  free (region);
+}
+
+/*
+ * Frees the regions of the current thread. Should be called after
+ * the supplemental page table is destroyed, which owns the pages.
+ */
+void
+region_destroy (void)
+{
+  struct thread *t = thread_current ();
+  if (t -> regions == NULL)
+    return;
+  while (!list_empty (t -> regions))
+  {
+    struct region *region = list_entry (list_pop_front (t -> regions),
+                                        struct region, elem);
+    while (!list_empty (&region -> superpages))
+    {
+      struct superpage *sp = list_entry (list_pop_front (&region -> superpages),
+                                         struct superpage, elem);
+      region_superpage_free (sp);
+      free (sp);
+    }
+    free (region);
+  }
+  free (t -> regions);
+  t -> regions = NULL;
+}
+
+/*
+ * Maps the 4 MB block around VADDR, a faulting address, as one
+ * superpage if it lies in a writable region of zero filled pages
+ * none of which was touched yet. Returns false if the block is left
+ * to 4 KB pages, because it does not qualify or no aligned physical
+ * memory is free. Such a block is not tried again.
+ */
+bool
+region_map_superpage (void *vaddr)
+{
+  struct thread *t = thread_current ();
+  uint8_t *upage = (uint8_t *) ((uintptr_t) vaddr & ~(SUPERPAGE_SIZE - 1));
+  struct region *region = region_find (vaddr);
+  struct list_elem *e;
+
+  if (!paging_pse || region == NULL || region -> file_mapped
+      || !region -> writable || t -> rss_limit != 0
+      || upage < (uint8_t *) region -> start
+      || upage + SUPERPAGE_SIZE > (uint8_t *) region -> end
+      || (uint32_t) (upage - (uint8_t *) region -> start) < region -> read_bytes
+      || region_superpage_find (region, upage) != NULL)
+    return false;
+
+  struct superpage *sp = malloc (sizeof (struct superpage));
+  if (sp == NULL)
+    return false;
+  sp -> upage = upage;
+  sp -> kpage = NULL;
+  list_push_back (&region -> superpages, &sp -> elem);
+  for (e = list_begin (&region -> pages); e != list_end (&region -> pages);
+       e = list_next (e))
+  {
+    uint8_t *page = list_entry (e, struct sup_page_table_entry,
+                                region_elem) -> vaddr;
+    if (page >= upage && page < upage + SUPERPAGE_SIZE)
+      goto fallback;
+  }
+  sp -> kpage = region_superpage_alloc ();
+  if (sp -> kpage == NULL)
+    goto fallback;
+  if (!pagedir_set_superpage (t -> pagedir, upage, sp -> kpage, true))
+  {
+    /* Part of the block is in use by the pages of another region. */
+    region_superpage_free (sp);
+    goto fallback;
+  }
+  memset (sp -> kpage, 0, SUPERPAGE_SIZE);
+  superpage_map_cnt++;
+  lock_acquire (&t -> pagedir_lock);
+  t -> rss += SUPERPAGE_PAGES;
+  lock_release (&t -> pagedir_lock);
+  return true;
+
+ fallback:
+  superpage_fallback_cnt++;
+  return false;
+}
+
+/*
+ * Lets the 4 MB blocks lying wholly between START and END be mapped
+ * as superpages if ALLOW, otherwise keeps them to 4 KB pages. Blocks
+ * which are already superpages stay so.
+ */
+void
+region_allow_superpages (void *start, void *end, bool allow)
+{
+  uint8_t *upage = (uint8_t *) ROUND_UP ((uintptr_t) start, SUPERPAGE_SIZE);
+  for (; upage + SUPERPAGE_SIZE <= (uint8_t *) end; upage += SUPERPAGE_SIZE)
+  {
+    struct region *region = region_find (upage);
+    if (region == NULL)
+      continue;
+    struct superpage *sp = region_superpage_find (region, upage);
+    if (allow && sp != NULL && sp -> kpage == NULL)
+    {
+      list_remove (&sp -> elem);
+      free (sp);
+    }
+    else if (!allow && sp == NULL)
+    {
+      sp = malloc (sizeof (struct superpage));
+      if (sp == NULL)
+        return;
+      sp -> upage = upage;
+      sp -> kpage = NULL;
+      list_push_back (&region -> superpages, &sp -> elem);
+    }
+  }
+}
+
+/*
+ * Discards the contents of the superpages of the current thread
+ * between START and END, for madvise(MADV_DONTNEED). A superpage
+ * lying partly outside the range is split: its other pages which are
+ * not all zeros are copied to 4 KB pages. Either way the block is
+ * kept to 4 KB pages from then on and the discarded pages fault back
+ * in as zeros. Returns false if memory ran out while copying.
+ */
+bool
+region_discard_superpages (void *start, void *end)
+{
+  struct list *regions = thread_current () -> regions;
+  struct list_elem *e, *s;
+  bool success = true;
+  if (regions == NULL)
+    return true;
+  for (e = list_begin (regions); e != list_end (regions); e = list_next (e))
+  {
+    struct region *region = list_entry (e, struct region, elem);
+    if (region -> start >= end)
+      break;
+    if (region -> end <= start)
+      continue;
+    for (s = list_begin (&region -> superpages);
+         s != list_end (&region -> superpages); s = list_next (s))
+    {
+      struct superpage *sp = list_entry (s, struct superpage, elem);
+      uint8_t *upage = sp -> upage;
+      uint8_t *first = upage > (uint8_t *) start ? upage : (uint8_t *) start;
+      uint8_t *last = upage + SUPERPAGE_SIZE < (uint8_t *) end ?
+                      upage + SUPERPAGE_SIZE : (uint8_t *) end;
+      if (sp -> kpage == NULL || first >= last)
+        continue;
+      if (first == upage && last == upage + SUPERPAGE_SIZE)
+      {
+        region_superpage_free (sp);
+        continue;
+      }
+      uint8_t *kpage = sp -> kpage;
+      memset (kpage + (first - upage), 0, last - first);
+      region_superpage_unmap (sp);
+      if (!region_copy_pages (upage, kpage))
+        success = false;
+      palloc_free_multiple (kpage, SUPERPAGE_PAGES);
+      lock_acquire (&superpage_lock);
+      superpage_cnt--;
+      lock_release (&superpage_lock);
+    }
+  }
+  return success;
+}
+
+void
+region_print_stats (void)
+{
+  printf ("Superpages: %lld mapped, %lld fallbacks\n", superpage_map_cnt,
+          superpage_fallback_cnt);
+}
+
+/*
+ * Returns the block of REGION containing VADDR, or NULL if it is
+ * neither a superpage nor excluded from superpages.
+ */
+static struct superpage *
+region_superpage_find (struct region *region, void *vaddr)
+{
+  struct list_elem *e;
+  for (e = list_begin (&region -> superpages);
+       e != list_end (&region -> superpages); e = list_next (e))
+  {
+    struct superpage *sp = list_entry (e, struct superpage, elem);
+    if ((uint8_t *) vaddr >= (uint8_t *) sp -> upage
+        && (uint8_t *) vaddr < (uint8_t *) sp -> upage + SUPERPAGE_SIZE)
+      return sp;
+  }
+  return NULL;
+}
+
+/*
+ * Allocates the memory for a superpage, if the superpages are within
+ * their share of the user pool.
+ */
+static void *
+region_superpage_alloc (void)
+{
+  void *kpage = NULL;
+  lock_acquire (&superpage_lock);
+  if ((superpage_cnt + 1) * SUPERPAGE_PAGES * 2 <= palloc_page_cnt (PAL_USER))
+    kpage = palloc_get_aligned (PAL_USER, SUPERPAGE_PAGES, SUPERPAGE_PAGES);
+  if (kpage != NULL)
+    superpage_cnt++;
+  lock_release (&superpage_lock);
+  return kpage;
+}
+
+/*
+ * Unmaps the superpage of SP, if any, from the current thread and
+ * returns its memory, or NULL if it has none. SP itself stays,
+ * keeping its block to 4 KB pages.
+ */
+static void *
+region_superpage_unmap (struct superpage *sp)
+{
+  struct thread *t = thread_current ();
+  void *kpage = sp -> kpage;
+  if (kpage == NULL)
+    return NULL;
+  if (t -> pagedir != NULL
+      && pagedir_clear_superpage (t -> pagedir, sp -> upage) != NULL)
+  {
+    lock_acquire (&t -> pagedir_lock);
+    t -> rss -= SUPERPAGE_PAGES;
+    lock_release (&t -> pagedir_lock);
+  }
+  sp -> kpage = NULL;
+  return kpage;
+}
+
+/*
+ * Unmaps the superpage of SP, if any, from the current thread and
+ * frees it. SP itself stays, keeping its block to 4 KB pages.
+ */
+static void
+region_superpage_free (struct superpage *sp)
+{
+  void *kpage = region_superpage_unmap (sp);
+  if (kpage == NULL)
+    return;
+  palloc_free_multiple (kpage, SUPERPAGE_PAGES);
+  lock_acquire (&superpage_lock);
+  superpage_cnt--;
+  lock_release (&superpage_lock);
+}
+
+static bool
+region_less (const struct list_elem *a, const struct list_elem *b,
+             void *aux UNUSED)
+{
+  return list_entry (a, struct region, elem) -> start
+         < list_entry (b, struct region, elem) -> start;
+}
@@ -0,0 +1,56 @@
+/* This file is for maintaining the regions of a process's address
+   space. A region is a range of pages backed the same way, its pages
+   get a supplemental page table entry only when first touched. */
+#ifndef VM_REGION_H
+#define VM_REGION_H
+
+#include "lib/kernel/list.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/file.h"
+
+struct sup_page_table_entry;
+struct thread;
+
+struct region
+{
+  void          *start;         /* First page of the region. */
+  void          *end;           /* Page right after the region. */
+  struct file   *file;          /* File the pages are read from. */
+  off_t         offset;         /* File offset of the first page. */
+  uint32_t      read_bytes;     /* Bytes read from the file, the rest is zero. */
+  bool          writable;
+  bool          file_mapped;    /* Set up by mmap, written back to the file. */
+  int           advice;         /* MADV_* access hint given by madvise(). */
+  struct list   pages;          /* Entries created so far. */
+  struct list   superpages;     /* Blocks mapped by or kept from superpages. */
+  struct list_elem elem;        /* Element in the region list, sorted by start. */
+};
+
+/* A 4 MB block of a region. Either it is mapped as one superpage or
+   it was excluded from superpages by madvise(). */
+struct superpage
+{
+  void          *upage;         /* User address of the block. */
+  void          *kpage;         /* The superpage, NULL if excluded. */
+  struct list_elem elem;        /* Element in the region's superpages. */
+};
+
+void region_superpage_init (void);
+void region_init (void);
+struct region *region_create (void *start, size_t page_cnt, struct file *file,
+                              off_t offset, uint32_t read_bytes,
+                              bool writable, bool file_mapped);
+struct region *region_find (void *vaddr);
+struct region *region_lookup (struct thread *, void *vaddr);
+struct region *region_copy (struct region *src, struct file *file);
+bool region_fork (struct thread *parent, struct file *exec_file);
+bool region_overlaps (void *start, size_t page_cnt);
+struct sup_page_table_entry *region_page_create (struct region *, void *vaddr);
+void region_remove (struct region *);
+void region_destroy (void);
+bool region_map_superpage (void *vaddr);
+void region_allow_superpages (void *start, void *end, bool allow);
+bool region_discard_superpages (void *start, void *end);
+void region_print_stats (void);
+#endif
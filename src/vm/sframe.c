@@ -21,7 +21,8 @@ unsigned hash_func (const struct hash_elem *e, void *aux UNUSED)
 {
   const struct sframe *p = hash_entry (e, struct sframe,
                                                   hash_elem);
-  return hash_bytes (&p -> inode, sizeof(struct inode *) + sizeof(off_t));
+  return hash_bytes (&p -> inode, sizeof(struct inode *) + sizeof(off_t)
+                     + sizeof(uint32_t));
 }
 /*
  * Compares the value of two hash elements A and B, given
@@ -37,7 +38,8 @@ bool less_func (const struct hash_elem *a,
   const struct sframe *b_entry = hash_entry (b, struct sframe,
                                                   hash_elem);
   bool b4;
-  b4 = (a_entry -> inode != b_entry -> inode || a_entry -> offset != b_entry -> offset);
+  b4 = (a_entry -> inode != b_entry -> inode || a_entry -> offset != b_entry -> offset
+        || a_entry -> read_bytes != b_entry -> read_bytes);
   return b4;
 }
 
@@ -57,12 +59,13 @@ sframe_init (void)
 static struct sframe *
 lookup_sframe (struct sup_page_table_entry *spt_entry)
 {
-struct sframe *sframe = (struct sframe *) malloc (sizeof(struct sframe));
+  /* Only the key of the entry is looked at. */
+  struct sframe key;
   ASSERT (spt_entry -> file != NULL);
-  sframe -> inode = file_get_inode (spt_entry -> file);
-  sframe -> offset = spt_entry -> offset;
-  struct hash_elem *hash_elem = hash_find (&sframe_table, &sframe -> hash_elem);
-  free (sframe);
+  key.inode = file_get_inode (spt_entry -> file);
+  key.offset = spt_entry -> offset;
+  key.read_bytes = spt_entry -> page_read_bytes;
+  struct hash_elem *hash_elem = hash_find (&sframe_table, &key.hash_elem);
   return hash_elem == NULL ? NULL : hash_entry (hash_elem, struct sframe, hash_elem);
 }
 
@@ -83,6 +86,10 @@ sframe_get (struct sup_page_table_entry *spt_entry)
     sframe = sframe_create();
     sframe -> inode = file_get_inode (spt_entry -> file);
     sframe -> offset = spt_entry -> offset;
+    sframe -> read_bytes = spt_entry -> page_read_bytes;
+    /* The frame may outlive the process which loaded it, so it
+       reads from a handle of its own. */
+    sframe -> file = file_reopen (spt_entry -> file);
     if (sframe)
       hash_insert (&sframe_table, &sframe -> hash_elem);
     ASSERT(sframe -> magic == SFRAME_MAGIC);
@@ -105,6 +112,7 @@ sframe_create ()
   if (sframe != NULL)
   {
     sframe -> magic = SFRAME_MAGIC;
+    sframe -> file = NULL;
     sframe -> frame = NULL;
     sframe -> mmapped_frame = NULL;
     lock_init (&sframe -> lk);
@@ -132,17 +140,14 @@ sframe_remove (struct sframe *sframe, struct sup_page_table_entry *spt_entry)
   {
     ASSERT(!lock_held_by_current_thread(&(*frame) -> lk));
     last = frame_dealloc (*frame, spt_entry -> vaddr);
-    ASSERT(!lock_held_by_current_thread(&(*frame) -> lk));
   }
   if (last)
     *frame = NULL;
   if (sframe -> mmapped_frame == NULL && sframe -> frame == NULL)
   {
-    struct sframe *temp_sframe = sframe_create();
-    temp_sframe -> inode = sframe -> inode;
-    temp_sframe -> offset = sframe -> offset;
-    hash_delete (&sframe_table, &temp_sframe -> hash_elem);
-    free (temp_sframe);
+    hash_delete (&sframe_table, &sframe -> hash_elem);
+    file_close (sframe -> file);
+    lock_release (&sframe -> lk);
     free (sframe);
     removed = true;
   }
@@ -14,10 +14,12 @@
 struct sframe
 {
   /* Do not change the order and location 
-     of the first two entries within the 
+     of the first three entries within the 
      structure */
   struct inode      *inode;
   off_t             offset;
+  uint32_t          read_bytes;
+  struct file       *file;          /* Private handle the frames read from. */
   struct frame      *frame;
   struct frame      *mmapped_frame;
   struct lock       lk;
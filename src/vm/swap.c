@@ -5,11 +5,24 @@
 #include "threads/synch.h"
 #include "threads/malloc.h"
 #include "threads/thread.h"
+#include "lib/string.h"
+#include <stdio.h>
+#include "vm/zswap.h"
 
 struct block *swap;
 struct bitmap *swap_pool;
 static struct lock bitmap_lock;
 
+/* Address of a frame in swap whose page was all zeros. Nothing is
+   stored for it, it is zero filled again on swap in. */
+#define SWAP_ZERO ((void *) -1)
+
+/* Statistics. */
+static long long write_cnt;     /* # of pages written to the swap device. */
+static long long read_cnt;      /* # of pages read from the swap device. */
+static long long zero_cnt;      /* # of zero pages dropped on swap out. */
+
+
 /* Should be called only after file system has been initialized. */
 void
 swap_init ()
@@ -23,21 +36,51 @@ swap_init ()
       swap = NULL;
     lock_init (&bitmap_lock);
   }
+  zswap_init ();
 }
 
 /* Moves the frame to the swap space updating its entries
-   to reflect the same. Returns true if swapping was successful,
+   to reflect the same. The frame is compressed into the zswap
+   pool if possible and written to the swap device otherwise.
+   Returns true if swapping was successful,
    false otherwise. Sould be called with lock on frame list acquired.*/
 bool
 swap_out (struct frame * frame)
 {
   //~ printf ("in swap_out \n");
+  if (page_is_zero (ptov ((uintptr_t)frame -> addr)))
+  {
+    frame -> addr = SWAP_ZERO;
+    frame -> in_swap = true;
+    zero_cnt++;
+    return true;
+  }
+  if (zswap_store (frame))
+    return true;
   bool swapped = false;
-  void * addr = 0;
-  if (has_swap())
+  size_t pg_idx = swap_write (ptov ((int)frame -> addr));
+  if (pg_idx != BITMAP_ERROR)
+  {
+    frame -> addr = (void *)pg_idx;
+    frame -> in_swap = true;
+    swapped = true;
+  }
+  //~ printf ("out swap_out \n\n");
+
+  return swapped;
+}
+
+/* Writes the page KPAGE to a free slot of the swap device.
+   Returns the slot, or BITMAP_ERROR if the swap is full. */
+size_t
+swap_write (const void *kpage)
+{
+  const void * addr = 0;
+  size_t pg_idx = BITMAP_ERROR;
+  if (swap != NULL)
   {
     lock_acquire (&bitmap_lock);
-    uint32_t pg_idx = bitmap_scan_and_flip (swap_pool, 0, 1, false);
+    pg_idx = bitmap_scan_and_flip (swap_pool, 0, 1, false);
     lock_release (&bitmap_lock);
     if (pg_idx != BITMAP_ERROR)
     {
@@ -45,18 +88,13 @@ swap_out (struct frame * frame)
       int i = 0;
       for (i = 0; i < (PGSIZE/BLOCK_SECTOR_SIZE); i++)
       {
-        //~ printf ("writing to block i: %d  %d %d \n", i, block_idx + i, ptov ((int)frame -> addr) + i * BLOCK_SECTOR_SIZE);
-        addr = ptov ((int)frame -> addr) + i * BLOCK_SECTOR_SIZE;
+        addr = kpage + i * BLOCK_SECTOR_SIZE;
         block_write (swap, block_idx  + i, addr);
       }
-      frame -> addr = (void *)pg_idx;
-      frame -> in_swap = true;
-      swapped = true;
+      write_cnt++;
     }
   }
-  //~ printf ("out swap_out \n\n");
-
-  return swapped;
+  return pg_idx;
 }
 
 /* Moves the FROM frame which is present is swap space to
@@ -65,16 +103,24 @@ swap_out (struct frame * frame)
 void
 swap_in (struct frame *from, struct frame *to)
 {
-  ASSERT (swap != NULL);
   ASSERT (from -> in_swap == true);
   ASSERT (to -> in_swap == false);
-  ASSERT (bitmap_test (swap_pool, (size_t) from -> addr));
   ASSERT (pg_ofs (to -> addr) == 0);
-  int i = 0;
-  block_sector_t block_idx = (uint32_t)from -> addr * (PGSIZE / BLOCK_SECTOR_SIZE);
-  for (i = 0; i < (PGSIZE / BLOCK_SECTOR_SIZE); i++)
+  if (from -> addr == SWAP_ZERO)
+    memset (ptov ((uintptr_t)to -> addr), 0, PGSIZE);
+  else if (zswap_owns (from -> addr))
+    zswap_load (from -> addr, ptov ((uintptr_t)to -> addr));
+  else
   {
-    block_read (swap, block_idx + i, (void *) ((void *)ptov((uintptr_t)to -> addr) + (i * BLOCK_SECTOR_SIZE)));
+    ASSERT (swap != NULL);
+    ASSERT (bitmap_test (swap_pool, (size_t) from -> addr));
+    int i = 0;
+    block_sector_t block_idx = (uint32_t)from -> addr * (PGSIZE / BLOCK_SECTOR_SIZE);
+    for (i = 0; i < (PGSIZE / BLOCK_SECTOR_SIZE); i++)
+    {
+      block_read (swap, block_idx + i, (void *) ((void *)ptov((uintptr_t)to -> addr) + (i * BLOCK_SECTOR_SIZE)));
+    }
+    read_cnt++;
   }
   swap_free (from -> addr);
   from -> in_swap = false;
@@ -85,14 +131,41 @@ swap_in (struct frame *from, struct frame *to)
 void
 swap_free (void *addr)
 {
+  if (addr == SWAP_ZERO)
+    return;
+  if (zswap_owns (addr))
+  {
+    zswap_free (addr);
+    return;
+  }
   lock_acquire (&bitmap_lock);
   ASSERT (bitmap_test (swap_pool, (size_t) addr));
   bitmap_reset (swap_pool, (size_t) addr);
   lock_release (&bitmap_lock);
 }
 
+/* Returns true if a swap device exists. */
 bool
 has_swap ()
 {
  return swap != NULL;
 }
+
+void
+swap_print_stats (void)
+{
+  printf ("Swap: %lld pages written, %lld pages read, %lld zero pages dropped\n",
+          write_cnt, read_cnt, zero_cnt);
+}
+
+/* Returns true if the page KPAGE contains only zeros. */
+bool
+page_is_zero (const void *kpage)
+{
+  const uint32_t *word = kpage;
+  size_t i;
+  for (i = 0; i < PGSIZE / sizeof *word; i++)
+    if (word[i] != 0)
+      return false;
+  return true;
+}
@@ -6,7 +6,10 @@
 
 void swap_init (void);
 bool swap_out (struct frame *);
+size_t swap_write (const void *);
 void swap_in (struct frame *, struct frame *);
 void swap_free (void *);
 bool has_swap (void);
+bool page_is_zero (const void *kpage);
+void swap_print_stats (void);
 #endif
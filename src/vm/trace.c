@@ -0,0 +1,125 @@
+/* This file is for accounting and tracing the page faults served by
+   the supplemental page table. Each fault is counted by type, timed
+   with the time stamp counter into a histogram, and recorded in a
+   ring of recent events along with the page evicted to serve it. */
+#include "vm/trace.h"
+#include <stdio.h>
+#include <string.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Latency histogram buckets. Bucket N counts faults served in less
+   than 2^(N + LATENCY_SHIFT) cycles, the last one the slower ones. */
+#define LATENCY_SHIFT 10
+#define LATENCY_BUCKETS 16
+
+/* Set by the -vmtrace option, prints the trace at shutdown. */
+bool vm_trace_dump;
+
+static struct vmtrace_event trace[VM_TRACE_SIZE];
+static unsigned trace_cnt;        /* # of events recorded ever. */
+static struct lock trace_lock;
+
+/* Statistics. */
+static long long type_cnt[VM_FAULT_TYPE_CNT];
+static long long type_cycles[VM_FAULT_TYPE_CNT];
+static long long latency_cnt[LATENCY_BUCKETS];
+
+static const char *type_names[VM_FAULT_TYPE_CNT] =
+  {"zero", "stack", "file", "swap", "shared", "cow", "minor"};
+
+void
+vm_trace_init (void)
+{
+  lock_init (&trace_lock);
+}
+
+/*
+ * Records a fault on the page ADDR of type TYPE which took CYCLES to
+ * serve. The page evicted meanwhile, if any, was noted by
+ * vm_trace_note_victim().
+ */
+void
+vm_trace_record (void *addr, int type, uint64_t cycles)
+{
+  struct thread *t = thread_current ();
+  int bucket = 0;
+  ASSERT (type >= 0 && type < VM_FAULT_TYPE_CNT);
+  while (bucket < LATENCY_BUCKETS - 1
+         && cycles >= (1ULL << (bucket + LATENCY_SHIFT)))
+    bucket++;
+
+  lock_acquire (&trace_lock);
+  struct vmtrace_event *e = &trace[trace_cnt++ % VM_TRACE_SIZE];
+  e -> addr = addr;
+  e -> type = type;
+  e -> pid = t -> tid;
+  e -> cycles = cycles > UINT32_MAX ? UINT32_MAX : cycles;
+  e -> victim = t -> fault_victim;
+  type_cnt[type]++;
+  type_cycles[type] += cycles;
+  latency_cnt[bucket]++;
+  lock_release (&trace_lock);
+  t -> fault_victim = NULL;
+}
+
+/*
+ * Notes that the page VADDR of some process was evicted to serve the
+ * fault the current thread is in.
+ */
+void
+vm_trace_note_victim (void *vaddr)
+{
+  thread_current () -> fault_victim = vaddr;
+}
+
+/*
+ * Copies the CNT most recent events, or as many as are kept, to
+ * EVENTS, oldest first. Returns the number of events copied.
+ */
+int
+vm_trace_copy (struct vmtrace_event *events, int cnt)
+{
+  int i;
+  lock_acquire (&trace_lock);
+  if ((unsigned) cnt > trace_cnt)
+    cnt = trace_cnt;
+  if (cnt > VM_TRACE_SIZE)
+    cnt = VM_TRACE_SIZE;
+  for (i = 0; i < cnt; i++)
+    events[i] = trace[(trace_cnt - cnt + i) % VM_TRACE_SIZE];
+  lock_release (&trace_lock);
+  return cnt;
+}
+
+void
+vm_trace_print_stats (void)
+{
+  int i;
+  printf ("Faults:");
+  for (i = 0; i < VM_FAULT_TYPE_CNT; i++)
+    printf (" %lld %s (%lld cycles avg)%s", type_cnt[i], type_names[i],
+            type_cnt[i] != 0 ? type_cycles[i] / type_cnt[i] : 0,
+            i + 1 < VM_FAULT_TYPE_CNT ? "," : "\n");
+  printf ("Fault latency:");
+  for (i = 0; i < LATENCY_BUCKETS; i++)
+    if (latency_cnt[i] != 0)
+      printf (" %s2^%d:%lld", i + 1 < LATENCY_BUCKETS ? "<" : ">=",
+              i + LATENCY_SHIFT - (i + 1 < LATENCY_BUCKETS ? 0 : 1),
+              latency_cnt[i]);
+  printf (" cycles\n");
+
+  if (!vm_trace_dump)
+    return;
+  unsigned first = trace_cnt > VM_TRACE_SIZE ? trace_cnt - VM_TRACE_SIZE : 0;
+  unsigned n;
+  for (n = first; n < trace_cnt; n++)
+  {
+    struct vmtrace_event *e = &trace[n % VM_TRACE_SIZE];
+    printf ("Fault %u: pid %d %p %s %u cycles", n, e -> pid, e -> addr,
+            type_names[e -> type], e -> cycles);
+    if (e -> victim != NULL)
+      printf (", evicted %p", e -> victim);
+    printf ("\n");
+  }
+}
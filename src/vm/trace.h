@@ -0,0 +1,21 @@
+/* This file is for accounting and tracing the page faults served by
+   the supplemental page table. */
+#ifndef VM_TRACE_H
+#define VM_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/thread.h"
+#include "userprog/syscall.h"
+
+/* Events kept in the trace, the older ones are overwritten. */
+#define VM_TRACE_SIZE 256
+
+extern bool vm_trace_dump;
+
+void vm_trace_init (void);
+void vm_trace_record (void *addr, int type, uint64_t cycles);
+void vm_trace_note_victim (void *vaddr);
+int vm_trace_copy (struct vmtrace_event *events, int cnt);
+void vm_trace_print_stats (void);
+#endif
@@ -26,13 +26,23 @@ struct sup_page_table_entry *vm_page_create (void *vaddr);
 struct sup_page_table_entry *vm_create_page_and_alloc (void *vaddr);
 void vm_page_destroy (struct sup_page_table_entry *pt_entry UNUSED);
 struct sup_page_table_entry * find_page_by_vaddr (void *vaddr);
+struct sup_page_table_entry * vm_page_get (void *vaddr);
+bool vm_pin (const void *uaddr, size_t length, bool write);
+void vm_unpin (const void *uaddr, size_t length);
 void sup_page_table_destroy (struct hash *sup_pt);
-bool sup_page_table_load (struct sup_page_table_entry *spt_entry);
+bool sup_page_table_load (struct sup_page_table_entry *spt_entry, bool write);
 void vm_page_remove (struct sup_page_table_entry *sup_pt);
+void sup_page_table_unload (struct sup_page_table_entry *spt_entry);
+bool sup_page_table_fork (struct thread *parent);
+void page_print_stats (void);
 
 void init_mmap (void);
 mapid_t vm_mmap (struct file *file, void *vaddr);
 void vm_unmap (mapid_t id);
+void vm_msync (mapid_t id);
+bool vm_madvise (void *addr, size_t length, int advice);
+void vm_mmap_writer_init (void);
 void vm_mmap_free (void);
+bool vm_mmap_fork (struct thread *parent);
 //void vm_demand_mapping (struct sup_page_table_entry *sup, uint32_t *pd);
 #endif
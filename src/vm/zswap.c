@@ -0,0 +1,327 @@
+/* This file is for maintaining the compressed swap pool.
+   Anonymous pages picked by the clock are compressed into an arena
+   of kernel pages and are written to the swap device only when the
+   arena fills up, oldest first. */
+#include "vm/zswap.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include "lib/kernel/bitmap.h"
+#include "lib/kernel/list.h"
+#include "lib/string.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/swap.h"
+
+/* The arena is handed out in chunks of ZSWAP_CHUNK bytes. */
+#define ZSWAP_CHUNK 64
+#define ZSWAP_CHUNK_CNT (ZSWAP_POOL_PAGES * PGSIZE / ZSWAP_CHUNK)
+
+/* Pages which do not compress below this size go straight to disk. */
+#define ZSWAP_MAX_LENGTH (PGSIZE * 3 / 4)
+
+#define ZSWAP_MAGIC 0x7a737770
+
+/* Codec parameters.  A control byte below LZ_MAX_LITERALS is
+   followed by (control + 1) literal bytes, otherwise it encodes a
+   match of ((control & 0x7f) + LZ_MIN_MATCH) bytes followed by a
+   two byte little endian backwards offset. */
+#define LZ_HASH_BITS 12
+#define LZ_HASH_SIZE (1 << LZ_HASH_BITS)
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH (0x7f + LZ_MIN_MATCH)
+#define LZ_MAX_LITERALS 0x80
+
+struct zswap_entry
+{
+  struct frame *frame;          /* Frame whose contents are stored here. */
+  size_t chunk;                 /* First chunk used in the arena. */
+  size_t chunk_cnt;             /* Number of chunks used. */
+  size_t length;                /* Compressed length in bytes. */
+  struct list_elem elem;        /* Element in the lru list. */
+  uint32_t magic;
+};
+
+static uint8_t *arena;            /* ZSWAP_POOL_PAGES contiguous pages. */
+static struct bitmap *arena_map;  /* Used chunks of the arena. */
+static struct list lru_list;      /* Stored entries, oldest first. */
+static struct lock zswap_lock;
+static uint8_t *zbuf;             /* Compression output. */
+static uint8_t *wbuf;             /* Decompressed page being written back. */
+static uint16_t lz_table[LZ_HASH_SIZE];
+
+/* Statistics. */
+static long long store_cnt;       /* # of pages stored compressed. */
+static long long hit_cnt;         /* # of pages swapped in from the pool. */
+static long long writeback_cnt;   /* # of pages written back to disk. */
+static long long reject_cnt;      /* # of pages that did not fit. */
+static long long original_bytes;
+static long long compressed_bytes;
+
+static bool zswap_writeback (void);
+static void zswap_release (struct zswap_entry *);
+static size_t lz_compress (const uint8_t *src, uint8_t *dst, size_t limit);
+static void lz_decompress (const uint8_t *src, size_t length, uint8_t *dst);
+
+/*
+ * Reserves the arena. If the kernel pool can not spare it the
+ * compressed tier stays disabled and swap goes straight to disk.
+ */
+void
+zswap_init ()
+{
+  list_init (&lru_list);
+  lock_init (&zswap_lock);
+  arena = palloc_get_multiple (0, ZSWAP_POOL_PAGES);
+  zbuf = palloc_get_page (0);
+  wbuf = palloc_get_page (0);
+  arena_map = bitmap_create (ZSWAP_CHUNK_CNT);
+  if (arena == NULL || zbuf == NULL || wbuf == NULL || arena_map == NULL)
+  {
+    if (arena != NULL)
+      palloc_free_multiple (arena, ZSWAP_POOL_PAGES);
+    if (zbuf != NULL)
+      palloc_free_page (zbuf);
+    if (wbuf != NULL)
+      palloc_free_page (wbuf);
+    if (arena_map != NULL)
+      bitmap_destroy (arena_map);
+    arena = NULL;
+  }
+}
+
+bool
+zswap_enabled ()
+{
+  return arena != NULL;
+}
+
+/* Returns true if ADDR, the address of a frame which is in swap,
+   refers to the compressed pool rather than a swap slot. Slots are
+   small indices while entries live in the kernel heap. */
+bool
+zswap_owns (void *addr)
+{
+  return is_kernel_vaddr (addr);
+}
+
+/* Compresses FRAME into the pool, writing the oldest entries back
+   to the swap device if there is no room. On success FRAME's addr
+   refers to the pool entry. Should be called with lock on frame list
+   acquired. */
+bool
+zswap_store (struct frame *frame)
+{
+  ASSERT (lock_held_by_current_thread (&frame_list_lock));
+  if (!zswap_enabled ())
+    return false;
+
+  lock_acquire (&zswap_lock);
+  size_t length = lz_compress (ptov ((uintptr_t) frame -> addr), zbuf,
+                               ZSWAP_MAX_LENGTH);
+  if (length == 0)
+  {
+    reject_cnt++;
+    lock_release (&zswap_lock);
+    return false;
+  }
+
+  size_t chunk_cnt = DIV_ROUND_UP (length, ZSWAP_CHUNK);
+  size_t chunk = bitmap_scan_and_flip (arena_map, 0, chunk_cnt, false);
+  while (chunk == BITMAP_ERROR)
+  {
+    if (!zswap_writeback ())
+    {
+      reject_cnt++;
+      lock_release (&zswap_lock);
+      return false;
+    }
+    chunk = bitmap_scan_and_flip (arena_map, 0, chunk_cnt, false);
+  }
+
+  struct zswap_entry *entry = malloc (sizeof (struct zswap_entry));
+  if (entry == NULL)
+  {
+    bitmap_set_multiple (arena_map, chunk, chunk_cnt, false);
+    reject_cnt++;
+    lock_release (&zswap_lock);
+    return false;
+  }
+  memcpy (arena + chunk * ZSWAP_CHUNK, zbuf, length);
+  entry -> frame = frame;
+  entry -> chunk = chunk;
+  entry -> chunk_cnt = chunk_cnt;
+  entry -> length = length;
+  entry -> magic = ZSWAP_MAGIC;
+  list_push_back (&lru_list, &entry -> elem);
+
+  store_cnt++;
+  original_bytes += PGSIZE;
+  compressed_bytes += length;
+  lock_release (&zswap_lock);
+
+  frame -> addr = entry;
+  frame -> in_swap = true;
+  return true;
+}
+
+/* Decompresses the pool entry ADDR into KPAGE. The entry stays in
+   the pool until zswap_free(). */
+void
+zswap_load (void *addr, void *kpage)
+{
+  struct zswap_entry *entry = addr;
+  ASSERT (entry -> magic == ZSWAP_MAGIC);
+  lock_acquire (&zswap_lock);
+  lz_decompress (arena + entry -> chunk * ZSWAP_CHUNK, entry -> length, kpage);
+  hit_cnt++;
+  lock_release (&zswap_lock);
+}
+
+/* Drops the pool entry ADDR. */
+void
+zswap_free (void *addr)
+{
+  struct zswap_entry *entry = addr;
+  ASSERT (entry -> magic == ZSWAP_MAGIC);
+  lock_acquire (&zswap_lock);
+  zswap_release (entry);
+  lock_release (&zswap_lock);
+}
+
+void
+zswap_print_stats (void)
+{
+  long long ratio = compressed_bytes != 0 ?
+                    original_bytes * 100 / compressed_bytes : 0;
+  printf ("Zswap: %lld stores, %lld hits, %lld writebacks, %lld rejects, "
+          "%lld.%02lld compression ratio\n", store_cnt, hit_cnt,
+          writeback_cnt, reject_cnt, ratio / 100, ratio % 100);
+}
+
+/* Moves the oldest entry of the pool to the swap device and points
+   its frame at the swap slot. Should be called with zswap_lock and
+   the lock on frame list acquired, which keeps the frame from being
+   swapped in or freed meanwhile. */
+static bool
+zswap_writeback (void)
+{
+  ASSERT (lock_held_by_current_thread (&zswap_lock));
+  if (list_empty (&lru_list))
+    return false;
+  struct zswap_entry *entry = list_entry (list_front (&lru_list),
+                                          struct zswap_entry, elem);
+  lz_decompress (arena + entry -> chunk * ZSWAP_CHUNK, entry -> length, wbuf);
+  size_t slot = swap_write (wbuf);
+  if (slot == BITMAP_ERROR)
+    return false;
+  entry -> frame -> addr = (void *) slot;
+  zswap_release (entry);
+  writeback_cnt++;
+  return true;
+}
+
+static void
+zswap_release (struct zswap_entry *entry)
+{
+  ASSERT (lock_held_by_current_thread (&zswap_lock));
+  bitmap_set_multiple (arena_map, entry -> chunk, entry -> chunk_cnt, false);
+  list_remove (&entry -> elem);
+  entry -> magic = 0;
+  free (entry);
+}
+
+static inline unsigned
+lz_hash (const uint8_t *p)
+{
+  uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Appends CNT literal bytes from SRC to DST at *OUT. */
+static bool
+lz_emit_literals (const uint8_t *src, size_t cnt, uint8_t *dst, size_t *out,
+                  size_t limit)
+{
+  while (cnt > 0)
+  {
+    size_t run = cnt < LZ_MAX_LITERALS ? cnt : LZ_MAX_LITERALS;
+    if (*out + 1 + run > limit)
+      return false;
+    dst[(*out)++] = run - 1;
+    memcpy (dst + *out, src, run);
+    *out += run;
+    src += run;
+    cnt -= run;
+  }
+  return true;
+}
+
+/* Compresses the page at SRC into DST, writing at most LIMIT bytes.
+   Returns the compressed length, or 0 if it would exceed LIMIT.
+   Uses lz_table, thus should be called with zswap_lock acquired. */
+static size_t
+lz_compress (const uint8_t *src, uint8_t *dst, size_t limit)
+{
+  size_t in = 0, out = 0, lit_start = 0;
+  memset (lz_table, 0, sizeof lz_table);
+  while (in + LZ_MIN_MATCH <= PGSIZE)
+  {
+    unsigned h = lz_hash (src + in);
+    size_t ref = lz_table[h];
+    lz_table[h] = in + 1;
+    if (ref != 0 && memcmp (src + ref - 1, src + in, LZ_MIN_MATCH) == 0)
+    {
+      size_t len = LZ_MIN_MATCH;
+      size_t ofs = in - --ref;
+      while (in + len < PGSIZE && len < LZ_MAX_MATCH
+             && src[ref + len] == src[in + len])
+        len++;
+      if (!lz_emit_literals (src + lit_start, in - lit_start, dst, &out, limit)
+          || out + 3 > limit)
+        return 0;
+      dst[out++] = LZ_MAX_LITERALS | (len - LZ_MIN_MATCH);
+      dst[out++] = ofs & 0xff;
+      dst[out++] = ofs >> 8;
+      in += len;
+      lit_start = in;
+    }
+    else
+      in++;
+  }
+  if (!lz_emit_literals (src + lit_start, PGSIZE - lit_start, dst, &out, limit))
+    return 0;
+  return out;
+}
+
+/* Expands LENGTH bytes of compressed data at SRC into the page DST. */
+static void
+lz_decompress (const uint8_t *src, size_t length, uint8_t *dst)
+{
+  size_t in = 0, out = 0;
+  while (in < length)
+  {
+    uint8_t control = src[in++];
+    if (control < LZ_MAX_LITERALS)
+    {
+      size_t run = control + 1;
+      ASSERT (out + run <= PGSIZE);
+      memcpy (dst + out, src + in, run);
+      in += run;
+      out += run;
+    }
+    else
+    {
+      size_t len = (control & 0x7f) + LZ_MIN_MATCH;
+      size_t ofs = src[in] | (src[in + 1] << 8);
+      in += 2;
+      ASSERT (ofs != 0 && ofs <= out && out + len <= PGSIZE);
+      /* Byte by byte, matches may overlap their own output. */
+      for (; len > 0; len--, out++)
+        dst[out] = dst[out - ofs];
+    }
+  }
+  ASSERT (out == PGSIZE);
+}
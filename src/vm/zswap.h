@@ -0,0 +1,18 @@
+/* This file is for maintaining the compressed swap pool */
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include "vm/frame.h"
+
+/* Number of kernel pages reserved for compressed pages. */
+#define ZSWAP_POOL_PAGES 32
+
+void zswap_init (void);
+bool zswap_enabled (void);
+bool zswap_owns (void *addr);
+bool zswap_store (struct frame *);
+void zswap_load (void *addr, void *kpage);
+void zswap_free (void *addr);
+void zswap_print_stats (void);
+#endif